@@ -17,9 +17,19 @@ namespace CZ
 
     class SRMAtomicRequest;
     class SRMPropertyBlob;
+    class SRMPixelTransfer;
+    class SRMEventReactor;
+    class SRMCommitGroup;
+    class SRMAllocCounter;
+    class SRMKMSState;
+    class SRMBlobCache;
+    class SRMFramebufferCache;
+    class SRMSwapchainPool;
+    class SRMTestCache;
     class SRMLease;
 
     struct SRMConnectorInterface;
+    struct SRMOverlayLayer;
 };
 
 #endif // SRMTYPES_H
@@ -0,0 +1,59 @@
+#include <CZ/SRM/SRMAllocCounter.h>
+
+using namespace CZ;
+
+#ifdef CZ_SRM_ALLOC_COUNTER
+
+#include <cstdlib>
+#include <new>
+
+static thread_local UInt64 AllocCount {};
+static thread_local Int32 PauseDepth {};
+
+static void *CountedAlloc(std::size_t size) noexcept
+{
+    if (PauseDepth == 0)
+        AllocCount++;
+
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new(std::size_t size)
+{
+    if (void *ptr = CountedAlloc(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return CountedAlloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return CountedAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+UInt64 SRMAllocCounter::Count() noexcept { return AllocCount; }
+SRMAllocCounter::Pause::Pause() noexcept { PauseDepth++; }
+SRMAllocCounter::Pause::~Pause() noexcept { PauseDepth--; }
+
+#else
+
+UInt64 SRMAllocCounter::Count() noexcept { return 0; }
+SRMAllocCounter::Pause::Pause() noexcept {}
+SRMAllocCounter::Pause::~Pause() noexcept {}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SRMALLOCCOUNTER_H
+#define SRMALLOCCOUNTER_H
+
+#include <CZ/SRM/SRM.h>
+
+/**
+ * @brief Per-thread heap allocation counter.
+ *
+ * Only active when SRM is built with `-Dframe_alloc_check=true`, which replaces the global
+ * `operator new`. Render threads then assert that the steady-state frame path (commit and
+ * page flip handling) performs no heap allocations after a warm-up period.
+ *
+ * @note This class is primarily used by SRM internally.
+ */
+class CZ::SRMAllocCounter
+{
+public:
+#ifdef CZ_SRM_ALLOC_COUNTER
+    static constexpr bool Enabled { true };
+#else
+    static constexpr bool Enabled { false };
+#endif
+
+    /**
+     * @brief Number of `operator new` calls made by the calling thread while not paused.
+     *
+     * Always 0 if not Enabled.
+     */
+    static UInt64 Count() noexcept;
+
+    /**
+     * @brief Excludes the allocations made within its scope, e.g. by user callbacks.
+     */
+    class Pause
+    {
+    public:
+        Pause() noexcept;
+        ~Pause() noexcept;
+        Pause(const Pause &) = delete;
+        Pause &operator=(const Pause &) = delete;
+    };
+};
+
+#endif // SRMALLOCCOUNTER_H
@@ -1,5 +1,15 @@
 #include <CZ/SRM/SRMAtomicRequest.h>
 #include <CZ/SRM/SRMDevice.h>
+#include <CZ/SRM/SRMCrtc.h>
+#include <CZ/SRM/SRMEventReactor.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <tuple>
+#include <unistd.h>
+#include <xf86drm.h>
 
 using namespace CZ;
 
@@ -11,31 +21,207 @@ std::shared_ptr<SRMAtomicRequest> SRMAtomicRequest::Make(SRMDevice *device) noex
         return {};
     }
 
-    drmModeAtomicReqPtr req { drmModeAtomicAlloc() };
-    if (!req) return {};
+    auto req { std::shared_ptr<SRMAtomicRequest>(new SRMAtomicRequest(device)) };
+    req->m_props.reserve(32);
+    return req;
+}
+
+int SRMAtomicRequest::commit(UInt32 flags, void *userData, bool forceRetry) noexcept
+{
+    if (m_dirty)
+        build();
+
+    {
+        const std::lock_guard<std::mutex> lock { device()->m_kmsState.mutex() };
+        fill(true);
+
+        // Nothing changed, but a page flip event may still be expected
+        if (m_objs.empty())
+            fill(false);
+    }
+
+    m_retryCount = 0;
+    m_retryStall = 0;
 
-    return std::shared_ptr<SRMAtomicRequest>(new SRMAtomicRequest(device, req));
+    if (forceRetry)
+    {
+        // EVENT + TEST is not allowed
+        const int testRet { testUntilIdle((flags & ~DRM_MODE_PAGE_FLIP_EVENT) | DRM_MODE_ATOMIC_TEST_ONLY, userData) };
+
+        // Rejected, no need to ask twice. If still busy after the deadline, the commit may block instead
+        if (testRet != 0 && testRet != -EBUSY)
+            return testRet;
+    }
+
+    const int ret { ioctl(flags, userData) };
+
+    if (ret == 0 && !(flags & DRM_MODE_ATOMIC_TEST_ONLY))
+    {
+        const std::lock_guard<std::mutex> lock { device()->m_kmsState.mutex() };
+        size_t p { 0 };
+
+        for (size_t o = 0; o < m_objs.size(); o++)
+            for (UInt32 i = 0; i < m_countProps[o]; i++, p++)
+                device()->m_kmsState.set(m_objs[o], m_propIds[p], m_values[p]);
+    }
+
+    return ret;
 }
 
-int SRMAtomicRequest::commit(UInt32 flags, SRMRenderer::Frame *frame, bool forceRetry) noexcept
+void SRMAtomicRequest::build() noexcept
 {
-    if (!forceRetry)
-        return drmModeAtomicCommit(device()->fd(), m_req, flags, frame);
+    std::sort(m_props.begin(), m_props.end(), [](const Prop &a, const Prop &b)
+    {
+        return std::tie(a.objectId, a.propertyId, a.seq) < std::tie(b.objectId, b.propertyId, b.seq);
+    });
 
-    int ret;
+    // Keep only the last value of each property
+    size_t n { 0 };
+
+    for (size_t i = 0; i < m_props.size(); i++)
+    {
+        if (i + 1 < m_props.size() && m_props[i + 1].objectId == m_props[i].objectId && m_props[i + 1].propertyId == m_props[i].propertyId)
+            continue;
+
+        m_props[n++] = m_props[i];
+    }
 
-    // EVENT + TEST is not allowed
-    const UInt32 testFlags { (flags & ~DRM_MODE_PAGE_FLIP_EVENT) | DRM_MODE_ATOMIC_TEST_ONLY };
-retry:
-    ret = drmModeAtomicCommit(device()->fd(), m_req, testFlags, frame);
+    m_props.resize(n);
+    m_dirty = false;
+}
+
+void SRMAtomicRequest::fill(bool diff) noexcept
+{
+    m_objs.clear();
+    m_countProps.clear();
+    m_propIds.clear();
+    m_values.clear();
 
-    if (ret == -16) // -EBUSY
+    for (const Prop &prop : m_props)
     {
-        usleep(2000);
-        goto retry;
+        if (diff && device()->m_kmsState.matches(prop.objectId, prop.propertyId, prop.value))
+            continue;
+
+        if (m_objs.empty() || m_objs.back() != prop.objectId)
+        {
+            m_objs.emplace_back(prop.objectId);
+            m_countProps.emplace_back(0);
+        }
+
+        m_countProps.back()++;
+        m_propIds.emplace_back(prop.propertyId);
+        m_values.emplace_back(prop.value);
     }
+}
+
+int SRMAtomicRequest::ioctl(UInt32 flags, void *userData) noexcept
+{
+    // Same as drmModeAtomicCommit()
+    if (m_objs.empty())
+        return 0;
 
-    return drmModeAtomicCommit(device()->fd(), m_req, flags, frame);
+    drm_mode_atomic atomic {};
+    atomic.flags = flags;
+    atomic.count_objs = m_objs.size();
+    atomic.objs_ptr = reinterpret_cast<UInt64>(m_objs.data());
+    atomic.count_props_ptr = reinterpret_cast<UInt64>(m_countProps.data());
+    atomic.props_ptr = reinterpret_cast<UInt64>(m_propIds.data());
+    atomic.prop_values_ptr = reinterpret_cast<UInt64>(m_values.data());
+    atomic.user_data = reinterpret_cast<UInt64>(userData);
+
+    return drmIoctl(device()->fd(), DRM_IOCTL_MODE_ATOMIC, &atomic) == 0 ? 0 : -errno;
+}
+
+int SRMAtomicRequest::testUntilIdle(UInt32 flags, void *userData) noexcept
+{
+    using namespace std::chrono;
+
+    // CRTCs of the request, if there are none any flip completion triggers a retry
+    std::array<UInt32, 8> crtcIds;
+    size_t crtcCount { 0 };
+
+    for (auto *crtc : device()->crtcs())
+        if (crtcCount < crtcIds.size() && std::find(m_objs.begin(), m_objs.end(), crtc->id()) != m_objs.end())
+            crtcIds[crtcCount++] = crtc->id();
+
+    const std::span<const UInt32> crtcs { crtcIds.data(), crtcCount };
+    auto *reactor { device()->m_reactor.get() };
+    const auto start { steady_clock::now() };
+    const auto deadline { start + microseconds(m_retryTimeout) };
+    int ret;
+
+    while (true)
+    {
+        // Taken before testing so that a flip completing in between is not missed
+        const UInt64 count { reactor ? reactor->flipCount(crtcs) : 0 };
+
+        ret = ioctl(flags, userData);
+
+        if (ret != -EBUSY)
+            break;
+
+        const auto now { steady_clock::now() };
+
+        if (now >= deadline)
+            break;
+
+        m_retryCount++;
+
+        // The busy commit may not have requested an event, so also retry after a backoff of up to 16 ms
+        const auto wakeup { std::min(deadline, now + milliseconds(1 << std::min(m_retryCount - 1, 4U))) };
+
+        if (reactor)
+            reactor->waitFlip(crtcs, count, wakeup);
+        else
+            std::this_thread::sleep_until(wakeup);
+    }
+
+    m_retryStall = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+    if (ret == -EBUSY)
+        device()->log(CZWarning, CZLN, "CRTCs still busy after {} retries ({} us)", m_retryCount, m_retryStall);
+    else if (m_retryCount > 0)
+        device()->log(CZTrace, CZLN, "Commit stalled {} us for pending flips ({} retries)", m_retryStall, m_retryCount);
+
+    return ret;
+}
+
+int SRMAtomicRequest::merge(const SRMAtomicRequest &other) noexcept
+{
+    for (const auto &prop : other.m_props)
+        addProperty(prop.objectId, prop.propertyId, prop.value);
+
+    return 0;
+}
+
+void SRMAtomicRequest::reset() noexcept
+{
+    m_props.clear();
+    m_seq = 0;
+    m_dirty = true;
+    clearAttachments();
+}
+
+void SRMAtomicRequest::clearAttachments() noexcept
+{
+    m_blobs.clear();
+
+    for (auto fd : m_fds)
+        close(fd);
+
+    m_fds.clear();
+}
+
+UInt64 *SRMAtomicRequest::value(UInt32 objectId, UInt32 propertyId) noexcept
+{
+    if (m_dirty)
+        build();
+
+    for (auto &prop : m_props)
+        if (prop.objectId == objectId && prop.propertyId == propertyId)
+            return &prop.value;
+
+    return nullptr;
 }
 
 void SRMAtomicRequest::attachPropertyBlob(std::shared_ptr<SRMPropertyBlob> blob) noexcept
@@ -45,19 +231,18 @@ void SRMAtomicRequest::attachPropertyBlob(std::shared_ptr<SRMPropertyBlob> blob)
 
 void SRMAtomicRequest::attachFd(int fd) noexcept
 {
-    if (fd >= 0)
-        m_fds.emplace(fd);
+    if (fd >= 0 && std::find(m_fds.begin(), m_fds.end(), fd) == m_fds.end())
+        m_fds.emplace_back(fd);
 }
 
 int SRMAtomicRequest::addProperty(UInt32 objectId, UInt32 propertyId, UInt64 value) noexcept
 {
-    return drmModeAtomicAddProperty(m_req, objectId, propertyId, value);
+    m_props.push_back({ objectId, propertyId, value, m_seq++ });
+    m_dirty = true;
+    return static_cast<int>(m_props.size());
 }
 
 SRMAtomicRequest::~SRMAtomicRequest() noexcept
 {
-    for (auto fd : m_fds)
-        close(fd);
-
-    drmModeAtomicFree(m_req);
+    reset();
 }
@@ -3,29 +3,122 @@
 
 #include <CZ/SRM/SRMRenderer.h>
 #include <xf86drmMode.h>
-#include <unordered_set>
 #include <memory>
+#include <vector>
 
+/**
+ * @brief Atomic request.
+ *
+ * Unlike drmModeAtomicReq, properties are kept in arrays owned by the request and submitted
+ * with DRM_IOCTL_MODE_ATOMIC directly, so after reset() the same object can be refilled and
+ * committed without heap allocations.
+ *
+ * Requests can also be used as templates: built once, then only patched through value()
+ * and committed again.
+ *
+ * Properties whose value matches the device's committed state (SRMKMSState) are not sent,
+ * and the state is updated after each successful commit.
+ */
 class CZ::SRMAtomicRequest final : public SRMObject
 {
 public:
     static std::shared_ptr<SRMAtomicRequest> Make(SRMDevice *device) noexcept;
     int addProperty(UInt32 objectId, UInt32 propertyId, UInt64 value) noexcept;
-    int commit(UInt32 flags, SRMRenderer::Frame *frame, bool forceRetry) noexcept;
+
+    /**
+     * @brief Commits the request.
+     *
+     * If forceRetry is true, the request is first tested and, while the kernel reports -EBUSY
+     * (a previous nonblocking commit on the same CRTCs is still pending), the test is repeated
+     * each time one of the affected CRTCs completes a flip, until retryTimeout() elapses.
+     * Requests rejected by the test for any other reason are not committed and the test error is returned.
+     *
+     * @return 0 on success or a negative errno value.
+     */
+    int commit(UInt32 flags, void *userData, bool forceRetry) noexcept;
+
+    /**
+     * @brief Sets the maximum time commit() waits for pending flips when forceRetry is true, in microseconds.
+     *
+     * Once elapsed the request is committed anyway and may fail with -EBUSY. Defaults to 100000 (100 ms).
+     */
+    void setRetryTimeout(UInt32 usec) noexcept { m_retryTimeout = usec; }
+
+    /**
+     * @brief Gets the retry timeout in microseconds.
+     *
+     * @see setRetryTimeout()
+     */
+    UInt32 retryTimeout() const noexcept { return m_retryTimeout; }
+
+    /**
+     * @brief Number of -EBUSY test commits during the last commit() call.
+     */
+    UInt32 retryCount() const noexcept { return m_retryCount; }
+
+    /**
+     * @brief Time the last commit() call spent waiting for pending flips, in microseconds.
+     */
+    UInt32 retryStall() const noexcept { return m_retryStall; }
+
+    // Appends the properties of other, which must outlive this request's commit
+    int merge(const SRMAtomicRequest &other) noexcept;
+
+    // Removes all properties, blobs and fds, keeping the allocated capacity
+    void reset() noexcept;
+
+    // Closes the attached fds and releases the blobs, keeping the properties (templates)
+    void clearAttachments() noexcept;
+
+    /**
+     * @brief Pointer to the value of a property, used to patch prebuilt requests.
+     *
+     * Remains valid until a property is added, merged or the request is reset.
+     *
+     * @return nullptr if the property was not added.
+     */
+    UInt64 *value(UInt32 objectId, UInt32 propertyId) noexcept;
 
     void attachPropertyBlob(std::shared_ptr<SRMPropertyBlob> blob) noexcept;
     void attachFd(int fd) noexcept;
 
     ~SRMAtomicRequest() noexcept;
     SRMDevice *device() const noexcept { return m_device; };
-    drmModeAtomicReqPtr request() const noexcept { return m_req; }
 private:
-    SRMAtomicRequest(SRMDevice *device, drmModeAtomicReqPtr req) noexcept :
-        m_device(device), m_req(req) {}
+    struct Prop
+    {
+        UInt32 objectId;
+        UInt32 propertyId;
+        UInt64 value;
+        UInt32 seq; // Insertion order, later values of the same property win
+    };
+
+    SRMAtomicRequest(SRMDevice *device) noexcept :
+        m_device(device) {}
+
+    // Sorts and deduplicates m_props
+    void build() noexcept;
+
+    // Fills the ioctl arrays, skipping values equal to the committed state if diff is true
+    void fill(bool diff) noexcept;
+    int ioctl(UInt32 flags, void *userData) noexcept;
+
+    // Tests the request until it no longer fails with -EBUSY or the retry timeout elapses
+    int testUntilIdle(UInt32 flags, void *userData) noexcept;
+
+    std::vector<Prop> m_props;
+    std::vector<UInt32> m_objs;
+    std::vector<UInt32> m_countProps;
+    std::vector<UInt32> m_propIds;
+    std::vector<UInt64> m_values;
     std::vector<std::shared_ptr<SRMPropertyBlob>> m_blobs;
-    std::unordered_set<int> m_fds;
+    std::vector<int> m_fds;
     SRMDevice *m_device;
-    drmModeAtomicReqPtr m_req;
+    UInt32 m_seq {};
+    UInt32 m_retryTimeout { 100000 };
+    UInt32 m_retryCount {};
+    UInt32 m_retryStall {};
+    bool m_dirty { false }; // Properties added since the last build()
 };
 
 #endif // CZ_SRMATOMICREQUEST_H
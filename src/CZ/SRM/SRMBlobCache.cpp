@@ -0,0 +1,88 @@
+#include <CZ/SRM/SRMBlobCache.h>
+#include <CZ/SRM/SRMPropertyBlob.h>
+
+#include <cstring>
+
+using namespace CZ;
+
+static constexpr size_t MaxEntries { 64 };
+static constexpr std::chrono::seconds IdleTimeout { 10 };
+
+UInt64 SRMBlobCache::Hash(const void *data, size_t size) noexcept
+{
+    // FNV-1a
+    const UInt8 *bytes { static_cast<const UInt8*>(data) };
+    UInt64 hash { 14695981039346656037ULL };
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+std::shared_ptr<SRMPropertyBlob> SRMBlobCache::get(const void *data, size_t size) noexcept
+{
+    const UInt64 hash { Hash(data, size) };
+    const auto now { std::chrono::steady_clock::now() };
+
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    Entry *lru { nullptr };
+
+    for (size_t i = 0; i < m_entries.size();)
+    {
+        Entry &entry { m_entries[i] };
+
+        if (entry.hash == hash && entry.data.size() == size && memcmp(entry.data.data(), data, size) == 0)
+        {
+            entry.lastUse = now;
+            return entry.blob;
+        }
+
+        const bool idle { entry.blob.use_count() == 1 };
+
+        if (idle && now - entry.lastUse > IdleTimeout)
+        {
+            std::swap(entry, m_entries.back());
+            m_entries.pop_back();
+            continue;
+        }
+
+        if (idle && (!lru || entry.lastUse < lru->lastUse))
+            lru = &entry;
+
+        i++;
+    }
+
+    // Full, reuse the memory and replace the kernel object of the least recently used idle entry
+    if (m_entries.size() >= MaxEntries)
+    {
+        if (!lru || !lru->blob->update(data, size))
+            return SRMPropertyBlob::MakeUncached(m_device, data, size);
+
+        lru->hash = hash;
+        lru->data.assign(static_cast<const UInt8*>(data), static_cast<const UInt8*>(data) + size);
+        lru->lastUse = now;
+        return lru->blob;
+    }
+
+    auto blob { SRMPropertyBlob::MakeUncached(m_device, data, size) };
+
+    if (!blob)
+        return {};
+
+    Entry &entry { m_entries.emplace_back() };
+    entry.hash = hash;
+    entry.data.assign(static_cast<const UInt8*>(data), static_cast<const UInt8*>(data) + size);
+    entry.blob = blob;
+    entry.lastUse = now;
+    return blob;
+}
+
+void SRMBlobCache::clear() noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    m_entries.clear();
+}
@@ -0,0 +1,45 @@
+#ifndef SRMBLOBCACHE_H
+#define SRMBLOBCACHE_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Per-device content-addressed cache of property blobs.
+ *
+ * Blobs with identical contents (mode infos, gamma LUTs, etc) share a single
+ * kernel object. Damage clips rarely repeat and bypass it (SRMPropertyBlob::MakeUncached()). Entries only referenced by the cache are idle: they are destroyed after
+ * a few seconds or recycled for new contents once the cache is full.
+ *
+ * @note This class is primarily used by SRM internally, see SRMPropertyBlob::Make().
+ */
+class CZ::SRMBlobCache final : public SRMObject
+{
+public:
+    SRMBlobCache(SRMDevice *device) noexcept : m_device(device) {}
+
+    // Returns a blob with the given contents, creating it if needed
+    std::shared_ptr<SRMPropertyBlob> get(const void *data, size_t size) noexcept;
+
+    // Destroys all entries, blobs still referenced elsewhere remain valid
+    void clear() noexcept;
+private:
+    struct Entry
+    {
+        UInt64 hash;
+        std::vector<UInt8> data;
+        std::shared_ptr<SRMPropertyBlob> blob;
+        std::chrono::steady_clock::time_point lastUse;
+    };
+
+    static UInt64 Hash(const void *data, size_t size) noexcept;
+
+    SRMDevice *m_device;
+    std::vector<Entry> m_entries;
+    std::mutex m_mutex;
+};
+
+#endif // SRMBLOBCACHE_H
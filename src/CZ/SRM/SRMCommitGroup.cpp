@@ -0,0 +1,83 @@
+#include <CZ/SRM/SRMCommitGroup.h>
+#include <CZ/SRM/SRMAtomicRequest.h>
+#include <CZ/SRM/SRMDevice.h>
+#include <CZ/SRM/SRMLog.h>
+
+#include <algorithm>
+
+using namespace CZ;
+
+std::shared_ptr<SRMCommitGroup> SRMCommitGroup::Make(SRMDevice *device) noexcept
+{
+    if (!device || !device->clientCaps().Atomic || !device->caps().CrtcInVBlankEvent)
+    {
+        SRMLog(CZError, CZLN, "Commit groups require atomic modesetting and DRM_CAP_CRTC_IN_VBLANK_EVENT");
+        return {};
+    }
+
+    auto req { SRMAtomicRequest::Make(device) };
+
+    if (!req)
+        return {};
+
+    return std::shared_ptr<SRMCommitGroup>(new SRMCommitGroup(device, req));
+}
+
+void SRMCommitGroup::join(SRMRenderer *rend) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    m_members.emplace_back(rend);
+    m_reqs.reserve(m_members.size());
+}
+
+void SRMCommitGroup::leave(SRMRenderer *rend) noexcept
+{
+    {
+        const std::lock_guard<std::mutex> lock { m_mutex };
+        std::erase(m_members, rend);
+    }
+
+    // The pending round may now be complete
+    m_cond.notify_all();
+}
+
+int SRMCommitGroup::submit(SRMAtomicRequest *req) noexcept
+{
+    std::unique_lock<std::mutex> lock { m_mutex };
+
+    if (m_reqs.empty())
+        m_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_timeout);
+
+    m_reqs.emplace_back(req);
+
+    const UInt64 round { m_round };
+    const auto deadline { m_deadline };
+
+    m_cond.wait_until(lock, deadline, [this, round]{
+        return m_round != round || m_reqs.size() >= m_members.size();
+    });
+
+    int &result { m_results[round % m_results.size()] };
+
+    if (m_round != round)
+        return result;
+
+    // Last member to arrive or deadline reached, commit on behalf of everyone
+    m_req->reset();
+
+    for (auto *member : m_reqs)
+        m_req->merge(*member);
+
+    // Each CRTC reports its own event, routed by the reactor and matched by SRMRenderer::dispatchFlipEvents()
+    result = m_req->commit(DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK, this, false);
+
+    if (result)
+        device()->log(CZTrace, CZLN, "Group commit of {} CRTCs failed: {}", m_reqs.size(), strerror(-result));
+
+    m_req->reset();
+    m_reqs.clear();
+    m_round++;
+    lock.unlock();
+    m_cond.notify_all();
+    return result;
+}
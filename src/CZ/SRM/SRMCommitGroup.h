@@ -0,0 +1,84 @@
+#ifndef SRMCOMMITGROUP_H
+#define SRMCOMMITGROUP_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Synchronized page flips across connectors of the same device.
+ *
+ * Connectors added to a group (see SRMConnector::setCommitGroup()) contribute their vsynced page flips
+ * to a single atomic commit, issued once every initialized member has submitted its frame or
+ * timeout() elapses since the first submission. All CRTCs of the commit latch the new framebuffers
+ * on the same vblank when their timings are equal, and the kernel validates one commit per refresh
+ * instead of one per connector.
+ *
+ * Presentation events are still delivered per connector. If the shared commit fails, each member
+ * falls back to committing its frame individually.
+ *
+ * Only available on devices with atomic modesetting and @ref SRMDevice::Caps::CrtcInVBlankEvent.
+ * Async (vsync disabled) and VRR flips, updates without a new frame (e.g. cursor moves) and
+ * TEST_ONLY commits bypass the group.
+ */
+class CZ::SRMCommitGroup final : public SRMObject
+{
+public:
+    /**
+     * @brief Creates a commit group for connectors of the given device.
+     *
+     * @return nullptr if the device doesn't support the required capabilities.
+     */
+    static std::shared_ptr<SRMCommitGroup> Make(SRMDevice *device) noexcept;
+
+    /**
+     * @brief Device the members belong to.
+     */
+    SRMDevice *device() const noexcept { return m_device; }
+
+    /**
+     * @brief Sets how long a member waits for the rest after submitting a frame, in microseconds.
+     *
+     * Idle members delay the others by up to this amount. Defaults to 3000 (3 ms).
+     */
+    void setTimeout(UInt32 usec) noexcept { m_timeout = usec; }
+
+    /**
+     * @brief Gets the timeout in microseconds.
+     *
+     * @see setTimeout()
+     */
+    UInt32 timeout() const noexcept { return m_timeout; }
+private:
+    friend class SRMRenderer;
+
+    SRMCommitGroup(SRMDevice *device, std::shared_ptr<SRMAtomicRequest> req) noexcept :
+        m_device(device), m_req(req) {}
+
+    // Called from the render threads of initialized members
+    void join(SRMRenderer *rend) noexcept;
+    void leave(SRMRenderer *rend) noexcept;
+
+    // Blocks until the round req belongs to is committed and returns the commit result
+    int submit(SRMAtomicRequest *req) noexcept;
+
+    SRMDevice *m_device;
+    UInt32 m_timeout { 3000 };
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<SRMRenderer*> m_members;
+
+    // Current round, reused to avoid per-frame allocations
+    UInt64 m_round {};
+    std::chrono::steady_clock::time_point m_deadline;
+    std::vector<SRMAtomicRequest*> m_reqs;
+    std::shared_ptr<SRMAtomicRequest> m_req; // Merged request
+    std::array<int, 4> m_results {}; // Indexed by round
+};
+
+#endif // SRMCOMMITGROUP_H
@@ -5,7 +5,9 @@
 #include <CZ/SRM/SRMDevice.h>
 #include <CZ/SRM/SRMLog.h>
 #include <CZ/SRM/SRMConnector.h>
+#include <CZ/SRM/SRMCommitGroup.h>
 #include <CZ/SRM/SRMConnectorMode.h>
+#include <CZ/SRM/SRMOverlayLayer.h>
 #include <CZ/Core/Utils/CZVectorUtils.h>
 #include <CZ/Ream/GBM/RGBMBo.h>
 #include <CZ/Ream/RImage.h>
@@ -17,6 +19,7 @@
 
 extern "C" {
 #include <libdisplay-info/info.h>
+#include <libdisplay-info/edid.h>
 }
 
 using namespace CZ;
@@ -55,6 +58,7 @@ bool SRMConnector::updateProperties(drmModeConnectorPtr res) noexcept
     m_isConnected = res->connection == DRM_MODE_CONNECTED;
     m_type = res->connector_type;
     m_nameId = res->connector_type_id;
+    m_vrrCapable = false;
 
     memset(&m_propIDs, 0, sizeof(m_propIDs));
 
@@ -101,7 +105,10 @@ bool SRMConnector::updateProperties(drmModeConnectorPtr res) noexcept
         else if (strcmp(prop->name, "subconnector") == 0)
             m_propIDs.subconnector = prop->prop_id;
         else if (strcmp(prop->name, "vrr_capable") == 0)
+        {
             m_propIDs.vrr_capable = prop->prop_id;
+            m_vrrCapable = props->prop_values[i] == 1;
+        }
 
         drmModeFreeProperty(prop);
     }
@@ -115,6 +122,7 @@ bool SRMConnector::updateNames(drmModeConnectorPtr res) noexcept
 {
     m_serial.clear();
     m_make = m_model = "Unknown";
+    m_vrrMinRefreshRate = m_vrrMaxRefreshRate = 0;
 
     if (!isConnected())
         return false;
@@ -177,6 +185,23 @@ bool SRMConnector::updateNames(drmModeConnectorPtr res) noexcept
         free(str);
     }
 
+    if (const auto *edid { di_info_get_edid(info) })
+    {
+        for (auto *const *desc { di_edid_get_display_descriptors(edid) }; *desc; desc++)
+        {
+            if (di_edid_display_descriptor_get_tag(*desc) != DI_EDID_DISPLAY_DESCRIPTOR_RANGE_LIMITS)
+                continue;
+
+            if (const auto *limits { di_edid_display_descriptor_get_range_limits(*desc) })
+            {
+                m_vrrMinRefreshRate = limits->min_vert_rate_hz;
+                m_vrrMaxRefreshRate = limits->max_vert_rate_hz;
+            }
+
+            break;
+        }
+    }
+
     di_info_destroy(info);
     drmModeFreePropertyBlob(blob);
     return 1;
@@ -440,7 +465,12 @@ bool SRMConnector::hasCursor() const noexcept
     return false;
 }
 
-bool SRMConnector::setCursor(UInt8 *pixels) noexcept
+SkISize SRMConnector::cursorSize() const noexcept
+{
+    return hasCursor() ? m_rend->cursorBufferSize : SkISize();
+}
+
+bool SRMConnector::setCursor(const UInt8 *pixels, SkISize size, SkIPoint hotspot) noexcept
 {
     if (!hasCursor())
         return false;
@@ -449,12 +479,30 @@ bool SRMConnector::setCursor(UInt8 *pixels) noexcept
 
     if (pixels)
     {
+        if (size.isEmpty() || size.width() > m_rend->cursorBufferSize.width() || size.height() > m_rend->cursorBufferSize.height())
+        {
+            log(CZError, CZLN, "Invalid cursor size {}x{}, max {}x{}", size.width(), size.height(),
+                m_rend->cursorBufferSize.width(), m_rend->cursorBufferSize.height());
+            return false;
+        }
+
         const auto i { 1 - m_rend->cursorI };
-        auto bo { m_rend->cursor[i].bo };
+        auto &cursor { m_rend->cursor[i] };
+        auto &staging { m_rend->cursorStaging };
+        const size_t stride { gbm_bo_get_stride(cursor.bo->bo()) };
+        const size_t rowSize { static_cast<size_t>(size.width()) * 4 };
+
+        // Transparent padding around the image, the plane may be larger than it
+        std::fill(staging.begin(), staging.end(), 0);
 
-        if (gbm_bo_write(bo->bo(), pixels, 64 * 64 * 4) != 0)
+        for (Int32 y = 0; y < size.height(); y++)
+            memcpy(&staging[y * stride], &pixels[y * rowSize], rowSize);
+
+        if (gbm_bo_write(cursor.bo->bo(), staging.data(), staging.size()) != 0)
             return false;
 
+        cursor.planeSize = m_rend->cursorPlaneSize(size);
+        cursor.hotspot = hotspot;
         m_rend->cursorVisible = true;
 
         if (m_rend->cursorAPI == SRMRenderer::CursorAPI::Atomic)
@@ -464,9 +512,14 @@ bool SRMConnector::setCursor(UInt8 *pixels) noexcept
         }
         else
         {
-            auto size { bo->size() };
-            drmModeSetCursor(device()->fd(), m_rend->crtc->id(), bo->planeHandle(0).u32, size.width(), size.height());
+            auto boSize { cursor.bo->size() };
+            drmModeSetCursor2(device()->fd(), m_rend->crtc->id(), cursor.bo->planeHandle(0).u32,
+                              boSize.width(), boSize.height(), hotspot.x(), hotspot.y());
             m_rend->cursorI = i;
+
+            // The hotspot may have changed, move it even if no position is pending
+            if (!m_rend->latchCursor())
+                drmModeMoveCursor(device()->fd(), m_rend->crtc->id(), m_rend->cursorPlanePos().x(), m_rend->cursorPlanePos().y());
         }
     }
     else
@@ -485,22 +538,56 @@ bool SRMConnector::setCursor(UInt8 *pixels) noexcept
     return true;
 }
 
-bool SRMConnector::setCursorPos(SkIPoint pos) noexcept
+bool SRMConnector::setCustomScanoutImage(std::shared_ptr<RImage> image) noexcept
 {
-    if (!hasCursor())
+    if (!m_rend || !m_rend->rendering || std::this_thread::get_id() != m_rend->threadId)
+    {
+        log(CZError, CZLN, "Custom scanout images can only be set from the paint callback");
         return false;
+    }
 
-    std::lock_guard<std::recursive_mutex> lock { m_rend->propsMutex };
+    if (device()->core()->m_disableScanout)
+        return false;
+
+    return m_rend->setScanoutImage(image);
+}
+
+void SRMConnector::lockCurrentBuffer(bool lock) noexcept
+{
+    m_currentBufferLocked = lock;
+}
 
-    m_rend->cursorPos = pos;
+bool SRMConnector::isCurrentBufferLocked() const noexcept
+{
+    return m_currentBufferLocked;
+}
 
-    if (m_rend->cursorAPI == SRMRenderer::CursorAPI::Atomic)
+UInt32 SRMConnector::setOverlayLayers(std::vector<SRMOverlayLayer> &layers) noexcept
+{
+    if (!m_rend)
     {
-        m_rend->atomicChanges.add(SRMRenderer::CHCursorPosition);
-        unlockRenderer(false);
+        for (auto &layer : layers)
+            layer.assigned = false;
+
+        return 0;
     }
-    else
-        drmModeMoveCursor(device()->fd(), m_rend->crtc->id(), pos.x(), pos.y());
+
+    std::lock_guard<std::recursive_mutex> lock { m_rend->propsMutex };
+    const UInt32 assigned { m_rend->assignOverlays(layers) };
+    unlockRenderer(false);
+    return assigned;
+}
+
+bool SRMConnector::setCursorPos(SkIPoint pos) noexcept
+{
+    if (!hasCursor())
+        return false;
+
+    // Never blocks, only the latest position is kept until the render thread latches it
+    m_rend->cursorLatchPos.store(static_cast<UInt64>(static_cast<UInt32>(pos.x())) << 32 | static_cast<UInt32>(pos.y()), std::memory_order_release);
+
+    if (!m_rend->cursorLatchDirty.exchange(true, std::memory_order_acq_rel))
+        unlockRenderer(false);
 
     return true;
 }
@@ -572,6 +659,63 @@ std::shared_ptr<RImage> SRMConnector::currentImage() const noexcept
     return m_rend ? m_rend->swapchain.image() : nullptr;
 }
 
+SkRegion SRMConnector::damageSince(UInt32 age) const noexcept
+{
+    SkRegion region;
+
+    if (!m_rend || m_rend->swapchain.images.empty())
+        return region;
+
+    if (!m_rend->swapchain.damageSince(age, region))
+        region.setRect(SkIRect::MakeSize(m_rend->swapchain.images[0]->size()));
+
+    return region;
+}
+
+bool SRMConnector::setBufferCount(UInt32 count) noexcept
+{
+    if (count < 2 || count > 4)
+    {
+        log(CZError, CZLN, "Invalid buffer count {} (must be 2, 3 or 4)", count);
+        return false;
+    }
+
+    if (m_bufferCount == count)
+        return true;
+
+    m_bufferCount = count;
+    unlockRenderer(false);
+    return true;
+}
+
+SRMPixelTransfer::Stats SRMConnector::transferStats() const noexcept
+{
+    if (!m_rend)
+        return {};
+
+    // The transfer is owned by the render thread, only its last snapshot is read here
+    const std::lock_guard<std::mutex> lock { m_rend->transferStatsMutex };
+    return m_rend->transferStats;
+}
+
+void SRMConnector::enableAdaptiveBuffering(bool enabled) noexcept
+{
+    if (m_adaptiveBuffering == enabled)
+        return;
+
+    m_adaptiveBuffering = enabled;
+    unlockRenderer(false);
+}
+
+void SRMConnector::enableIdleRefreshRate(bool enabled) noexcept
+{
+    if (m_idleRefreshRate == enabled)
+        return;
+
+    m_idleRefreshRate = enabled;
+    unlockRenderer(false);
+}
+
 UInt64 SRMConnector::gammaSize() const noexcept
 {
     return m_rend ? m_rend->crtc->gammaSize() : 0;
@@ -643,7 +787,7 @@ bool SRMConnector::setGammaLUT(std::shared_ptr<const RGammaLUT> gammaLUT) noexce
         const auto G { gammaLUT->green() };
         const auto B { gammaLUT->blue() };
 
-        std::vector<drm_color_lut> table;
+        auto &table { m_rend->gammaTable };
         table.resize(gammaLUT->size());
 
         for (size_t i = 0; i < gammaLUT->size(); i++)
@@ -653,6 +797,7 @@ bool SRMConnector::setGammaLUT(std::shared_ptr<const RGammaLUT> gammaLUT) noexce
             table[i].blue = B[i];
         }
 
+        // Identical LUTs (e.g. the identity one) share the same blob
         m_rend->gammaBlob = SRMPropertyBlob::Make(device(), table.data(), table.size() * sizeof(*table.data()));
 
         if (!m_rend->gammaBlob)
@@ -679,6 +824,69 @@ bool SRMConnector::setGammaLUT(std::shared_ptr<const RGammaLUT> gammaLUT) noexce
     return true;
 }
 
+bool SRMConnector::setCommitGroup(std::shared_ptr<SRMCommitGroup> group) noexcept
+{
+    if (m_rend)
+    {
+        log(CZError, CZLN, "The commit group can only be changed while uninitialized");
+        return false;
+    }
+
+    if (group && group->device() != device())
+    {
+        log(CZError, CZLN, "The commit group belongs to another device");
+        return false;
+    }
+
+    m_commitGroup = group;
+    return true;
+}
+
+bool SRMConnector::enableVRR(bool enabled) noexcept
+{
+    if (enabled && !isVRRCapable())
+    {
+        log(CZError, CZLN, "Failed to enable VRR (unsupported by the display)");
+        return false;
+    }
+
+    if (!m_rend)
+    {
+        m_vrr = enabled;
+        return true;
+    }
+
+    if (!m_rend->crtc->m_propIDs.VRR_ENABLED)
+    {
+        log(CZError, CZLN, "Failed to toggle VRR (unsupported by the CRTC)");
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock { m_rend->propsMutex };
+
+    if (m_vrr == enabled)
+        return true;
+
+    if (device()->clientCaps().Atomic)
+    {
+        m_vrr = enabled;
+        m_rend->atomicChanges |= SRMRenderer::CHVRR;
+        unlockRenderer(false);
+    }
+    else
+    {
+        if (drmModeObjectSetProperty(device()->fd(), m_rend->crtc->id(), DRM_MODE_OBJECT_CRTC, m_rend->crtc->m_propIDs.VRR_ENABLED, enabled))
+        {
+            log(CZError, CZLN, "Failed to toggle VRR (drmModeObjectSetProperty)");
+            return false;
+        }
+
+        m_vrr = enabled;
+    }
+
+    return true;
+}
+
 void SRMConnector::setContentType(RContentType type, bool force) noexcept
 {
     if (!m_propIDs.content_type || !m_rend)
@@ -924,252 +1132,4 @@ SRM_CONNECTOR_CONTENT_TYPE srmConnectorGetContentType(SRMConnector *connector)
     return connector->contentType;
 }
 
-UInt8 srmConnectorSetCustomScanoutBuffer(SRMConnector *connector, SRMBuffer *buffer)
-{
-    if (!connector->inPaintGL || connector->device->core->customBufferScanoutIsDisabled || connector->pendingModeSetting)
-        return 0;
-
-    if (buffer == connector->userScanoutBufferRef[0])
-    {
-        SRMDebug("[%s] [%s] Custom scanout buffer succesfully set.",
-                 connector->device->shortName,
-                 connector->name);
-        return 1;
-    }
-
-    srmConnectorReleaseUserScanoutBuffer(connector, 0);
-
-    if (!buffer)
-    {
-        SRMDebug("[%s] [%s] Custom scanout buffer succesfully unset.",
-                 connector->device->shortName,
-                 connector->name);
-        return 0;
-    }
-
-    if (connector->device != buffer->allocator)
-    {
-        SRMError("[%s] [%s] Failed to set custom scanout buffer. The buffer allocator must match the connector's device.",
-                 connector->device->shortName,
-                 connector->name);
-        return 0;
-    }
-
-    SRMConnectorMode *mode = srmConnectorGetCurrentMode(connector);
-
-    if (srmConnectorModeGetWidth(mode) != srmBufferGetWidth(buffer) || srmConnectorModeGetHeight(mode) != srmBufferGetHeight(buffer))
-    {
-        SRMError("[%s] [%s] Failed to set custom scanout buffer. The buffer dimensions must match the connector's mode size.",
-                 connector->device->shortName,
-                 connector->name);
-        return 0;
-    }
-
-    if (srmBufferGetTexture(connector->device, buffer).id == 0)
-    {
-        SRMError("[%s] [%s] Failed to set custom scanout buffer. The buffer is not supported by the connector's device.",
-                 connector->device->shortName,
-                 connector->name);
-        return 0;
-    }
-
-    /* Already created */
-
-    if (buffer->scanout.fb)
-    {
-        if (!srmFormatIsInList(connector->currentPrimaryPlane->inFormats, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier)
-            || srmFormatIsInList(connector->currentPrimaryPlane->inFormatsBlacklist, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier))
-        {
-            if (buffer->scanout.usingAlphaSubstitute)
-            {
-                SRMError("[%s] [%s] Failed to set custom scanout buffer. Format not supported by the primary plane.",
-                         connector->device->shortName,
-                         connector->name);
-
-                return 0;
-            }
-            else
-            {
-                buffer->scanout.fmt.format = srmFormatGetAlphaSubstitute(buffer->scanout.fmt.format);
-                buffer->scanout.usingAlphaSubstitute = 1;
-
-                if (!srmFormatIsInList(connector->currentPrimaryPlane->inFormats, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier)
-                    || srmFormatIsInList(connector->currentPrimaryPlane->inFormatsBlacklist, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier))
-                {
-                    SRMError("[%s] [%s] Failed to set custom scanout buffer. Unsupported format/modifier: %s - %s.",
-                             connector->device->shortName,
-                             connector->name,
-                             drmGetFormatName(buffer->scanout.fmt.format),
-                             drmGetFormatModifierName(buffer->scanout.fmt.modifier));
-                    return 0;
-                }
-            }
-        }
-
-        connector->userScanoutBufferRef[0] = srmBufferGetRef(buffer);
-        return 1;
-    }
-
-    struct gbm_bo *bo = NULL;
-
-    /* If the buffer already has a bo*/
-    if (buffer->bo)
-        bo = buffer->bo;
-    else
-    {
-        struct SRMBufferTexture *texture;
-        SRMListForeach(item, buffer->textures)
-        {
-            texture = srmListItemGetData(item);
-
-            if (texture->device == connector->device)
-            {
-                /* If already contains an EGL Image */
-                if (texture->image != EGL_NO_IMAGE)
-                {
-                    bo = gbm_bo_import(connector->device->gbm, GBM_BO_IMPORT_EGL_IMAGE, texture->image, GBM_BO_USE_SCANOUT);
-
-                    if (!bo)
-                        break;
-
-                    buffer->scanout.bo = bo;
-                }
-
-                break;
-            }
-        }
-    }
-
-    if (!bo)
-    {
-        SRMError("[%s] [%s] Failed to set custom scanout buffer. Could not get a GBM bo.",
-                 connector->device->shortName,
-                 connector->name);
-        return 0;
-    }
-
-    connector->userScanoutBufferRef[0] = srmBufferGetRef(buffer);
-
-    Int32 ret = 1;
-    UInt32 handles[4] = {0};
-    UInt32 pitches[4] = {0};
-    UInt32 offsets[4] = {0};
-    UInt64 modifiers[4] = {0};
-
-    Int32 planesCount = gbm_bo_get_plane_count(bo);
-    buffer->scanout.fmt.format = gbm_bo_get_format(bo);
-    buffer->scanout.fmt.modifier = gbm_bo_get_modifier(bo);
-
-    if (!srmFormatIsInList(connector->currentPrimaryPlane->inFormats, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier)
-        || srmFormatIsInList(connector->currentPrimaryPlane->inFormatsBlacklist, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier))
-    {
-        UInt32 oldFmt = buffer->scanout.fmt.format;
-        buffer->scanout.fmt.format = srmFormatGetAlphaSubstitute(buffer->scanout.fmt.format);
-        buffer->scanout.usingAlphaSubstitute = 1;
-
-        SRMError("[%s] [%s] Failed to set custom scanout buffer. Format %s not supported by primary plane. Trying alpha substitute format %s",
-                 connector->device->shortName,
-                 connector->name,
-                 drmGetFormatName(oldFmt),
-                 drmGetFormatName(buffer->scanout.fmt.format));
-
-        if (!srmFormatIsInList(connector->currentPrimaryPlane->inFormats, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier)
-            || srmFormatIsInList(connector->currentPrimaryPlane->inFormatsBlacklist, buffer->scanout.fmt.format, buffer->scanout.fmt.modifier))
-        {
-            SRMError("[%s] [%s] Failed to set custom scanout buffer. Unsupported format/modifier: %s - %s.",
-                     connector->device->shortName,
-                     connector->name,
-                     drmGetFormatName(buffer->scanout.fmt.format),
-                     drmGetFormatModifierName(buffer->scanout.fmt.modifier));
-            goto releaseAndFail;
-        }
-    }
-
-    for (Int32 i = 0; i < planesCount; i++)
-    {
-        handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
-        pitches[i] = gbm_bo_get_stride_for_plane(bo, i);
-        offsets[i] = gbm_bo_get_offset(bo, i);
-        modifiers[i] = gbm_bo_get_modifier(bo);
-    }
-
-    if (connector->device->capAddFb2Modifiers && buffer->scanout.fmt.modifier != DRM_FORMAT_MOD_INVALID)
-    {
-        ret = drmModeAddFB2WithModifiers(
-            connector->device->fd,
-            buffer->dma.width, buffer->dma.height,
-            buffer->scanout.fmt.format, handles, pitches, offsets, modifiers,
-            &buffer->scanout.fb, DRM_MODE_FB_MODIFIERS);
-    }
-
-    if (ret)
-    {
-        SRMError("[%s] [%s] Failed to set custom scanout buffer using drmModeAddFB2WithModifiers(), trying drmModeAddFB2().",
-                 connector->device->shortName,
-                 connector->name);
-
-        if (buffer->scanout.fmt.modifier != DRM_FORMAT_MOD_INVALID && buffer->scanout.fmt.modifier != DRM_FORMAT_MOD_LINEAR)
-        {
-            SRMError("[%s] [%s] Failed to set custom scanout buffer. drmModeAddFB2() and drmModeAddFB() do not support explicit modifiers.",
-                     connector->device->shortName,
-                     connector->name);
-            goto releaseAndFail;
-        }
-
-        ret = drmModeAddFB2(
-            connector->device->fd,
-            buffer->dma.width, buffer->dma.height,
-            buffer->scanout.fmt.format, handles, pitches, offsets,
-            &buffer->scanout.fb, DRM_MODE_FB_MODIFIERS);
-    }
-
-    if (ret && planesCount == 1 && offsets[0] == 0)
-    {
-        SRMError("[%s] [%s] Failed to set custom scanout buffer using drmModeAddFB2(), trying drmModeAddFB().",
-                 connector->device->shortName,
-                 connector->name);
-
-        UInt32 depth, bpp;
-        srmFormatGetDepthBpp(buffer->scanout.fmt.format, &depth, &bpp);
-
-        if (depth == 0 || bpp == 0)
-        {
-            SRMError("[%s] [%s] Failed to set custom scanout buffer using drmModeAddFB(), could not get depth and bpp for format %s.",
-                     connector->device->shortName,
-                     connector->name,
-                     drmGetFormatName(buffer->scanout.fmt.format));
-            goto releaseAndFail;
-        }
-
-        ret = drmModeAddFB(
-            connector->device->fd,
-            buffer->dma.width, buffer->dma.height,
-            depth, bpp, pitches[0], handles[0],
-            &buffer->scanout.fb);
-    }
-
-    if (ret)
-    {
-        SRMError("[%s] [%s] Failed to set custom scanout buffer using drmModeAddFB().",
-                 connector->device->shortName,
-                 connector->name);
-        goto releaseAndFail;
-    }
-
-    return 1;
-
-releaseAndFail:
-    srmConnectorReleaseUserScanoutBuffer(connector, 0);
-    return 0;
-}
-
-void srmConnectorSetCurrentBufferLocked(SRMConnector *connector, UInt8 locked)
-{
-    connector->lockCurrentBuffer = locked;
-}
-
-UInt8 srmConnectorIsCurrentBufferLocked(SRMConnector *connector)
-{
-    return connector->lockCurrentBuffer;
-}
 #endif
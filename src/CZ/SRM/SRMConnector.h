@@ -15,6 +15,7 @@
 #include <CZ/Core/CZWeak.h>
 #include <CZ/Core/CZPresentationTime.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <xf86drm.h>
@@ -38,6 +39,20 @@ class CZ::SRMConnector : public SRMObject
 {
 public:
 
+    /**
+     * @brief Paint scheduling policy.
+     *
+     * @see setPaintScheduling()
+     */
+    enum class PaintScheduling
+    {
+        /// The paint event is triggered as soon as repaint() is called (default)
+        Immediate,
+
+        /// The paint event is delayed until just before the predicted vblank deadline
+        Deadline
+    };
+
     /**
      * @brief Destructor.
      */
@@ -203,23 +218,55 @@ public:
      */
     bool hasCursor() const noexcept;
 
+    /**
+     * @brief Maximum cursor image size accepted by setCursor().
+     *
+     * Depends on the driver caps and the cursor plane size hints, typically 64x64 or larger.
+     *
+     * @return The size in pixels or an empty size if hasCursor() is false.
+     */
+    SkISize cursorSize() const noexcept;
+
     /**
      * @brief Set the pixels of the cursor plane.
      *
      * This function sets the pixels of the hardware cursor for the given @ref SRMConnector.
      *
-     * The format of the buffer must be **ARGB8888** with a size of 64x64 pixels.
+     * The format of the buffer must be **ARGB8888** with a stride of `size.width() * 4` bytes.
      * Passing `nullptr` as the buffer hides the cursor.
+     *
+     * @param size Image size, must not exceed cursorSize().
+     * @param hotspot Point within the image placed at the position given to setCursorPos().
      */
-    bool setCursor(UInt8 *pixels) noexcept;
+    bool setCursor(const UInt8 *pixels, SkISize size = { 64, 64 }, SkIPoint hotspot = { 0, 0 }) noexcept;
 
     /**
      * @brief Set the cursor position.
      *
-     * @param po Position in pixel coords relative to the top-left origin of the connector image.
+     * Never blocks. Only the latest position is kept, the render thread applies it shortly before
+     * the next vblank, together with the frame being presented if any.
+     *
+     * @param po Position of the cursor hotspot in pixel coords relative to the top-left origin of the connector image.
      */
     bool setCursorPos(SkIPoint pos) noexcept;
 
+    /**
+     * @brief Assigns layers to overlay planes.
+     *
+     * Layers are tried in the given order, each on the free overlay planes of the connector's CRTC, and
+     * every assignment is validated with `DRM_MODE_ATOMIC_TEST_ONLY` against the ones before it. Layers left
+     * with SRMOverlayLayer::assigned set to false must be composited by the caller.
+     *
+     * Assigned layers are presented by the next page flip and remain until this function is called again
+     * or the mode changes. Passing an empty list releases the planes.
+     *
+     * Intended to be called from the @ref SRMConnectorInterface::paint callback before rendering.
+     * Requires atomic modesetting.
+     *
+     * @return The number of assigned layers.
+     */
+    UInt32 setOverlayLayers(std::vector<SRMOverlayLayer> &layers) noexcept;
+
     /**
      * @brief Checks if the connector is being leased.
      */
@@ -297,6 +344,90 @@ public:
 
     std::shared_ptr<RImage> currentImage() const noexcept;
 
+    /**
+     * @brief Sets the number of swapchain images.
+     *
+     * Supported values are 2 (double buffering, the default), 3 and 4. With 3 or more images the next frame can be
+     * painted while the previous page flip is still pending, at the cost of extra memory and up to one frame of latency.
+     *
+     * If the connector is initialized, the swapchain is reallocated before the next paint event, followed by a
+     * @ref SRMConnectorInterface::resized event. If the allocation fails, the previous swapchain is kept.
+     *
+     * @see images() to get the number of images currently in use.
+     *
+     * @return true on success, false if the count is out of range.
+     */
+    bool setBufferCount(UInt32 count) noexcept;
+
+    /**
+     * @brief Returns the requested number of swapchain images.
+     *
+     * @see setBufferCount()
+     */
+    UInt32 bufferCount() const noexcept { return m_bufferCount; }
+
+    /**
+     * @brief Pixel transfer timings of the Dumb strategy.
+     *
+     * With the Dumb strategy each frame is read back into a staging buffer and then copied into the
+     * scanout buffer by a worker pool (see the **CZ_SRM_TRANSFER_THREADS** environment variable).
+     *
+     * @return The timings of the last frames, or zeroed stats if the Dumb strategy or the parallel transfer are not in use.
+     */
+    SRMPixelTransfer::Stats transferStats() const noexcept;
+
+    /**
+     * @brief Toggles adaptive buffering.
+     *
+     * When enabled, the connector uses double buffering and switches to `max(3, bufferCount())` images after
+     * paint events repeatedly exceed the refresh period, returning to double buffering after one second without repaints.
+     *
+     * Disabled by default.
+     */
+    void enableAdaptiveBuffering(bool enabled) noexcept;
+
+    /**
+     * @brief Checks if adaptive buffering is enabled.
+     *
+     * @see enableAdaptiveBuffering()
+     */
+    bool isAdaptiveBufferingEnabled() const noexcept { return m_adaptiveBuffering; }
+
+    /**
+     * @brief Toggles the idle refresh rate.
+     *
+     * When enabled, after idleRefreshRateDelay() milliseconds without repaints or cursor updates, the CRTC switches to
+     * the lowest refresh rate mode with the resolution of currentMode() that the driver can apply without a modeset.
+     * The swapchain is kept and any activity restores currentMode() before the next frame.
+     *
+     * Only applies to eDP panels with atomic modesetting, and is inactive while VRR is in use.
+     * currentMode() is unaffected.
+     *
+     * Disabled by default.
+     */
+    void enableIdleRefreshRate(bool enabled) noexcept;
+
+    /**
+     * @brief Checks if the idle refresh rate is enabled.
+     *
+     * @see enableIdleRefreshRate()
+     */
+    bool isIdleRefreshRateEnabled() const noexcept { return m_idleRefreshRate; }
+
+    /**
+     * @brief Sets how long the screen must remain static before lowering the refresh rate, in milliseconds.
+     *
+     * Defaults to 1000.
+     */
+    void setIdleRefreshRateDelay(UInt32 msec) noexcept { m_idleRefreshRateDelay = msec; }
+
+    /**
+     * @brief Gets the idle refresh rate delay in milliseconds.
+     *
+     * @see setIdleRefreshRateDelay()
+     */
+    UInt32 idleRefreshRateDelay() const noexcept { return m_idleRefreshRateDelay; }
+
     /**
      * @brief Get the subpixel layout associated with a connector.
      *
@@ -371,6 +502,101 @@ public:
      */
     bool enableVSync(bool enabled) noexcept;
 
+    /**
+     * @brief Checks if the connected display supports variable refresh rate (adaptive sync).
+     *
+     * @see enableVRR()
+     */
+    bool isVRRCapable() const noexcept { return m_vrrCapable; }
+
+    /**
+     * @brief Minimum vertical refresh rate in Hz reported by the display EDID range limits.
+     *
+     * @return The minimum refresh rate or 0 if unknown.
+     */
+    UInt32 vrrMinRefreshRate() const noexcept { return m_vrrMinRefreshRate; }
+
+    /**
+     * @brief Maximum vertical refresh rate in Hz reported by the display EDID range limits.
+     *
+     * @return The maximum refresh rate or 0 if unknown.
+     */
+    UInt32 vrrMaxRefreshRate() const noexcept { return m_vrrMaxRefreshRate; }
+
+    /**
+     * @brief Toggles variable refresh rate (adaptive sync).
+     *
+     * When enabled, frames are presented as soon as they are ready instead of at a fixed cadence,
+     * and @ref PaintScheduling::Deadline is ignored.
+     *
+     * If the content rate drops below vrrMinRefreshRate(), the current frame is repeated
+     * (low framerate compensation) so that the panel stays within its supported range.
+     *
+     * Disabled by default. If the connector is uninitialized, the value is applied once initialized.
+     *
+     * @return true on success, false if unsupported by the display or the CRTC.
+     */
+    bool enableVRR(bool enabled) noexcept;
+
+    /**
+     * @brief Checks if variable refresh rate is enabled.
+     *
+     * @see enableVRR()
+     */
+    bool isVRREnabled() const noexcept { return m_vrr; }
+
+    /**
+     * @brief Sets the paint scheduling policy.
+     *
+     * With @ref PaintScheduling::Deadline, the render thread predicts the next vblank from the last page flip
+     * timestamp and the mode timings, and delays the paint event until `vblank - paintCost - margin`, where
+     * `paintCost` is the maximum paint + commit duration of the last frames. This reduces input-to-photon
+     * latency by up to one refresh period.
+     *
+     * Frames are painted immediately when vsync is disabled or when there is no recent vblank to predict from.
+     *
+     * @see setPaintDeadlineMargin()
+     */
+    void setPaintScheduling(PaintScheduling scheduling) noexcept { m_paintScheduling = scheduling; }
+
+    /**
+     * @brief Gets the paint scheduling policy.
+     *
+     * @see setPaintScheduling()
+     */
+    PaintScheduling paintScheduling() const noexcept { return m_paintScheduling; }
+
+    /**
+     * @brief Sets the safety margin of the @ref PaintScheduling::Deadline policy in microseconds.
+     *
+     * Larger values reduce the chances of missing a vblank at the cost of latency. Defaults to 1000 (1 ms).
+     */
+    void setPaintDeadlineMargin(UInt32 usec) noexcept { m_paintDeadlineMargin = usec; }
+
+    /**
+     * @brief Gets the safety margin of the @ref PaintScheduling::Deadline policy in microseconds.
+     */
+    UInt32 paintDeadlineMargin() const noexcept { return m_paintDeadlineMargin; }
+
+    /**
+     * @brief Adds the connector to a commit group, or removes it if nullptr.
+     *
+     * Vsynced page flips of connectors in the same group are issued as a single atomic commit.
+     * Can only be changed while the connector is uninitialized.
+     *
+     * @see SRMCommitGroup
+     *
+     * @return true on success, false if initialized or if the group belongs to another device.
+     */
+    bool setCommitGroup(std::shared_ptr<SRMCommitGroup> group) noexcept;
+
+    /**
+     * @brief Gets the commit group.
+     *
+     * @see setCommitGroup()
+     */
+    std::shared_ptr<SRMCommitGroup> commitGroup() const noexcept { return m_commitGroup; }
+
     /**
      * @brief Paint event id.
      *
@@ -403,24 +629,25 @@ public:
     RContentType contentType() const noexcept { return m_contentType; }
 
     /**
-     * @brief Sets a custom scanout buffer for the primary plane.
+     * @brief Sets a custom scanout image for the primary plane.
      *
-     * This function allows you to set a custom scanout buffer for the primary plane only during a single frame.
-     * It must called within a `paintGL()` event. Calling it outside a `paintGL()` will result in an error.
+     * This function allows you to set a custom scanout image for the primary plane only during a single frame.
+     * It must called within a @ref SRMConnectorInterface::paint event. Calling it outside will result in an error.
      *
-     * If successfully set, the current buffer index is not updated, and no OpenGL rendering operations should be performed within the `paintGL()` event.
-     * If not set again in subsequent frames, the connector's framebuffers are restored, and the current buffer index continues to be updated as usual.
+     * If successfully set, the current image index is not updated, and no rendering operations should be performed within the paint event.
+     * If not set again in subsequent frames, the connector's images are restored, and the image index continues to be updated as usual
+     * (starting with an age of 0).
      *
-     * @note The size of the buffer must match the dimensions of the current connector's mode.
+     * @note The size of the image must match the dimensions of the current connector's mode, and its format/modifier (or its
+     *       opaque alpha substitute, e.g. XRGB8888 for ARGB8888) must be supported by the primary plane.
      *
-     * If successfully set, the internal reference counter of the buffer is increased, ensuring it remains scannable for at least the given frame
-     * even if it is destroyed.
+     * If successfully set, a reference to the image is kept until the next page flip completes, ensuring it remains
+     * scannable even if the caller releases it.
      *
-     * @note If `SRM_DISABLE_CUSTOM_SCANOUT` is set to 1, this function always return 0.
+     * @note If `CZ_SRM_DISABLE_DIRECT_SCANOUT` is set to 1, this function always returns false.
      *
-     * @param connector A pointer to the @ref SRMConnector instance.
-     * @param buffer The buffer to scan, or `NULL` to restore the default connector framebuffers.
-     * @return 1 if the custom buffer will be scanned, 0 otherwise.
+     * @param image The image to scan, or `nullptr` to restore the default connector images.
+     * @return true if the custom image will be scanned, false otherwise.
      */
     bool setCustomScanoutImage(std::shared_ptr<RImage> image) noexcept;
 
@@ -434,22 +661,21 @@ public:
     bool isNonDesktop() const noexcept { return m_nonDesktop; };
 
     /**
-     * @brief Locks the buffer currently being displayed and ignores srmConnectorRepaint() calls.
+     * @brief Locks the buffer currently being displayed and ignores repaint() calls.
      *
-     * When set to 1, no `paintGL()` or `pageFlipped()` events are triggered. The default value is 0.
+     * When set to true, no @ref SRMConnectorInterface::paint or @ref SRMConnectorInterface::presented events are triggered.
+     * Cursor, gamma and other property updates are still applied. The default value is false.
      *
-     * @param connector The @ref SRMConnector instance.
-     * @param locked    A value of 1 locks the current buffer, 0 unlocks it.
+     * @param lock true locks the current buffer, false unlocks it.
      */
     void lockCurrentBuffer(bool lock) noexcept;
 
     /**
      * @brief Retrieves the locked state of the current buffer.
      *
-     * @see srmConnectorSetCurrentBufferLocked()
+     * @see lockCurrentBuffer()
      *
-     * @param connector The @ref SRMConnector instance.
-     * @return          A value of 1 indicates the current buffer is locked, 0 indicates it is unlocked.
+     * @return true if the current buffer is locked, false otherwise.
      */
     bool isCurrentBufferLocked() const noexcept;
 
@@ -471,13 +697,26 @@ public:
     /**
      * @brief Damaged region during a paintGL event.
      *
-     * Should be filled with the area updated during paintGL(), helping the graphics backend
-     * to minimize the number of pixels copied (raster backend, hybrid GPU setups, etc).
+     * Should be filled with the area that changed compared to the previous frame (frame damage), helping the graphics
+     * backend to minimize the number of pixels copied (raster backend, hybrid GPU setups, etc). Damage of older
+     * frames is tracked internally, see damageSince().
      *
      * Defined in image-local coordinates. Automatically reset to full damage ((0, 0), currentImage().size()) before each paintGL() call.
      */
     SkRegion damage;
 
+    /**
+     * @brief Accumulated damage of previous frames.
+     *
+     * Returns the union of the @ref damage of the last `age - 1` frames, that is, the region that must be
+     * repainted in addition to the current frame damage to bring an image of the given age up to date.
+     *
+     * Typically called during a paint event with imageAge().
+     *
+     * @return The accumulated damage, or the full image rect if the age is 0 (undefined content) or exceeds the history.
+     */
+    SkRegion damageSince(UInt32 age) const noexcept;
+
     CZLogger log { SRMLog };
 
 private:
@@ -517,7 +756,19 @@ private:
     bool m_isConnected {};
     bool m_nonDesktop {};
     bool m_vsync { true };
+    std::atomic<bool> m_adaptiveBuffering {};
+    bool m_idleRefreshRate {};
+    UInt32 m_idleRefreshRateDelay { 1000 };
+    std::atomic<UInt32> m_bufferCount { 2 };
+    PaintScheduling m_paintScheduling { PaintScheduling::Immediate };
+    UInt32 m_paintDeadlineMargin { 1000 };
     bool m_leased {};
+    std::atomic<bool> m_currentBufferLocked {};
+    bool m_vrrCapable {};
+    std::atomic<bool> m_vrr {};
+    UInt32 m_vrrMinRefreshRate {};
+    UInt32 m_vrrMaxRefreshRate {};
+    std::shared_ptr<SRMCommitGroup> m_commitGroup;
 
     CZWeak<SRMConnectorMode> m_currentMode;
     CZWeak<SRMConnectorMode> m_preferredMode;
@@ -67,7 +67,8 @@ namespace CZ
         /**
          * @brief Notifies a change in the image dimensions.
          *
-         * Called when the connector’s current mode changes, affecting image size.
+         * Called when the connector’s current mode changes, affecting image size, or when
+         * the swapchain images are reallocated (e.g. after SRMConnector::setBufferCount()).
          *
          * @param connector Pointer to the SRMConnector instance.
          * @param data      User-defined data passed to SRMConnector::initialize().
@@ -7,3 +7,23 @@ bool SRMConnectorMode::isPreferred() const noexcept
 {
     return connector()->preferredMode() == this;
 }
+
+UInt64 SRMConnectorMode::period() const noexcept
+{
+    if (info().clock == 0 || info().htotal == 0 || info().vtotal == 0)
+        return info().vrefresh == 0 ? 0 : 1000000000 / info().vrefresh;
+
+    // clock is in kHz
+    UInt64 lines { info().vtotal };
+
+    if (info().flags & DRM_MODE_FLAG_INTERLACE)
+        lines /= 2;
+
+    if (info().flags & DRM_MODE_FLAG_DBLSCAN)
+        lines *= 2;
+
+    if (info().vscan > 1)
+        lines *= info().vscan;
+
+    return (static_cast<UInt64>(info().htotal) * lines * 1000000) / info().clock;
+}
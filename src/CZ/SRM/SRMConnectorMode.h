@@ -49,6 +49,15 @@ public:
      */
     UInt32 refreshRate() const noexcept { return info().vrefresh; }
 
+    /**
+     * @brief Get the refresh period in nanoseconds.
+     *
+     * Unlike refreshRate(), which is rounded to an integer, the period is calculated from the pixel clock and timings.
+     *
+     * @return The duration of a refresh cycle, or 0 if unknown.
+     */
+    UInt64 period() const noexcept;
+
     /**
      * @brief Check if the connector mode is the preferred mode by the connector.
      *
@@ -9,7 +9,9 @@
 #include <CZ/Core/Utils/CZVectorUtils.h>
 #include <CZ/Core/CZCore.h>
 #include <CZSRMVersion.h>
+#include <algorithm>
 #include <cstring>
+#include <future>
 #include <libudev.h>
 #include <sys/epoll.h>
 #include <sys/poll.h>
@@ -117,9 +119,11 @@ bool SRMCore::init() noexcept
     setenv("CZ_SRM_FORCE_LEGACY_CURSOR",           "0", 0);
     setenv("CZ_SRM_FORCE_GL_ALLOCATION",           "0", 0);
     setenv("CZ_SRM_ENABLE_WRITEBACK_CONNECTORS",   "0", 0);
-    setenv("CZ_SRM_DISABLE_CUSTOM_SCANOUT",        "0", 0);
+    setenv("CZ_SRM_DISABLE_DIRECT_SCANOUT",        "0", 0);
     setenv("CZ_SRM_DISABLE_CURSOR",                "0", 0);
     setenv("CZ_SRM_NVIDIA_CURSOR",                 "1", 0);
+    setenv("CZ_SRM_TRANSFER_THREADS",              "0", 0);
+    setenv("CZ_SRM_DUMB_ZERO_COPY",                "1", 0);
 
     SRMLog(CZInfo, "SRM version {}.{}.{}.",
            CZ_SRM_VERSION_MAJOR,
@@ -138,6 +142,14 @@ bool SRMCore::init() noexcept
     m_forceLegacyCursor = env && atoi(env) == 1;
     SRMLog(CZInfo, "Forcing Legacy Cursor IOCTLs: {}.", m_forceLegacyCursor);
 
+    env = getenv("CZ_SRM_DUMB_ZERO_COPY");
+    m_dumbZeroCopy = env && atoi(env) == 1;
+    SRMLog(CZInfo, "Zero-Copy Dumb Buffers (Raster): {}.", m_dumbZeroCopy);
+
+    env = getenv("CZ_SRM_TRANSFER_THREADS");
+    m_transferThreads = env ? std::clamp(atoi(env), 0, 16) : 0;
+    SRMLog(CZInfo, "Dumb Transfer Threads: {}.", m_transferThreads == 0 ? "Auto" : std::to_string(m_transferThreads));
+
     const bool ret {
         initUdev() &&
         initDevices() &&
@@ -163,6 +175,22 @@ bool SRMCore::initUdev() noexcept
 
 bool SRMCore::initDevices() noexcept
 {
+    // Each device is probed on its own thread, results are merged in enumeration order
+    std::vector<std::future<SRMDevice*>> probes;
+
+    auto probe = [&probes](auto &&func)
+    {
+        try
+        {
+            probes.emplace_back(std::async(std::launch::async, func));
+        }
+        catch (...)
+        {
+            // Failed to create the thread
+            probes.emplace_back(std::async(std::launch::deferred, func));
+        }
+    };
+
     if (m_fds.empty())
     {
         udev_enumerate *enumerate;
@@ -171,7 +199,6 @@ bool SRMCore::initDevices() noexcept
         udev_device *pci;
         const char *path;
         const char *bootVGA;
-        SRMDevice *device;
 
         enumerate = udev_enumerate_new(m_udev);
 
@@ -187,6 +214,7 @@ bool SRMCore::initDevices() noexcept
         udev_enumerate_scan_devices(enumerate);
         devices = udev_enumerate_get_list_entry(enumerate);
 
+        // udev is not thread-safe, only the device nodes are passed to the threads
         udev_list_entry_foreach(list, devices)
         {
             path = udev_list_entry_get_name(list);
@@ -197,10 +225,12 @@ bool SRMCore::initDevices() noexcept
             if (pci)
                 bootVGA = udev_device_get_sysattr_value(pci, "boot_vga");
 
-            device = SRMDevice::Make(this, udev_device_get_devnode(dev), bootVGA && strcmp(bootVGA, "1") == 0);
-
-            if (device)
-                m_devices.emplace_back(device);
+            if (const char *node { udev_device_get_devnode(dev) })
+            {
+                probe([this, nodePath = std::string(node), isBootVGA = bootVGA && strcmp(bootVGA, "1") == 0]{
+                    return SRMDevice::Make(this, nodePath.c_str(), isBootVGA);
+                });
+            }
 
             udev_device_unref(dev);
         }
@@ -210,14 +240,13 @@ bool SRMCore::initDevices() noexcept
     else
     {
         for (auto &fd : m_fds)
-        {
-            auto *dev { SRMDevice::Make(this, fd.get()) };
-
-            if (dev)
-                m_devices.emplace_back(dev);
-        }
+            probe([this, fd = fd.get()]{ return SRMDevice::Make(this, fd); });
     }
 
+    for (auto &result : probes)
+        if (auto *device { result.get() })
+            m_devices.emplace_back(device);
+
     return !m_devices.empty();
 }
 
@@ -420,8 +449,12 @@ bool SRMCore::resume() noexcept
 
     m_isSuspended = false;
 
+    // Another DRM master may have changed the state
     for (auto *dev : m_devices)
+    {
+        dev->initKMSState();
         dev->dispatchHotplugEvents();
+    }
 
     return true;
 }
@@ -170,6 +170,8 @@ private:
     bool m_forceLegacyCursor {};
     bool m_disableCursor {};
     bool m_disableScanout {};
+    bool m_dumbZeroCopy {};
+    Int32 m_transferThreads {}; // Dumb strategy pixel transfer threads, 0 = auto
 
     std::shared_ptr<RCore> m_ream;
 
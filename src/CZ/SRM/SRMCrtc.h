@@ -2,6 +2,7 @@
 #define SRMCRTC_H
 
 #include <CZ/SRM/SRMObject.h>
+#include <CZ/SRM/SRMTestCache.h>
 #include <xf86drmMode.h>
 
 /**
@@ -61,6 +62,11 @@ public:
      * @brief Checks if the CRTC is being leased.
      */
     bool leased() const noexcept { return m_leased; }
+
+    /**
+     * @brief Outcomes of the plane configurations tested on this CRTC (overlays, direct scanout).
+     */
+    const SRMTestCache &testCache() const noexcept { return m_testCache; }
 private:
     friend class SRMDevice;
     friend class SRMConnector;
@@ -80,6 +86,7 @@ private:
     UInt64 m_gammaSizeLegacy { 0 };
     UInt64 m_gammaSize { 0 };
     bool m_leased {};
+    SRMTestCache m_testCache;
     struct PropIDs
     {
         UInt32
@@ -12,11 +12,15 @@
 #include <cstring>
 #include <fcntl.h>
 #include <memory>
+#include <mutex>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
 using namespace CZ;
 
+// Devices are probed concurrently, the interface callbacks may not be thread-safe
+static std::mutex IfaceMutex;
+
 static bool DeviceInBlacklist(const char *nodePath)
 {
     const char *blacklist { getenv("CZ_SRM_DEVICE_BLACKLIST") };
@@ -211,8 +215,15 @@ SRMDevice::~SRMDevice() noexcept
     CZVectorUtils::DeleteAndPopBackAll(m_encoders);
     CZVectorUtils::DeleteAndPopBackAll(m_crtcs);
 
+    // Must stop reading the fd before it's closed
+    m_reactor.reset();
+    m_blobCache.clear();
+    m_fbCache.clear();
+    m_swapchainPool.clear();
+
     if (fd() >= 0 && core()->m_fds.empty())
     {
+        const std::lock_guard<std::mutex> lock { IfaceMutex };
         core()->m_iface->closeRestricted(fd(), core()->m_ifaceData);
         m_fd = -1;
     }
@@ -222,6 +233,7 @@ bool SRMDevice::init() noexcept
 {
     if (core()->m_fds.empty())
     {
+        const std::lock_guard<std::mutex> lock { IfaceMutex };
         m_fd = core()->m_iface->openRestricted(m_nodePath.c_str(), O_RDWR | O_CLOEXEC, core()->m_ifaceData);
 
         if (fd() < 0)
@@ -256,6 +268,14 @@ bool SRMDevice::init() noexcept
     initClientCaps();
     initCaps();
 
+    m_reactor = SRMEventReactor::Make(this);
+
+    if (!m_reactor)
+    {
+        log(CZError, CZLN, "Failed to create the DRM event reactor");
+        return false;
+    }
+
     drmModeResPtr res { drmModeGetResources(fd()) };
 
     if (!res)
@@ -268,14 +288,59 @@ bool SRMDevice::init() noexcept
         initCrtcs(res) &&
         initEncoders(res) &&
         initPlanes() &&
-        initCrtcs(res) &&
         initConnectors(res)
     };
 
     drmModeFreeResources(res);
+
+    if (ret)
+        initKMSState();
+
     return ret;
 }
 
+void SRMDevice::initKMSState() noexcept
+{
+    if (!clientCaps().Atomic)
+        return;
+
+    for (auto *plane : m_planes)
+    {
+        m_kmsState.addVolatileProperty(plane->m_propIDs.FB_ID);
+        m_kmsState.addVolatileProperty(plane->m_propIDs.IN_FENCE_FD);
+        m_kmsState.addVolatileProperty(plane->m_propIDs.FB_DAMAGE_CLIPS);
+    }
+
+    // The kernel sets it to BAD on link failures, GOOD must always be sent to retrain the link
+    for (auto *conn : m_connectors)
+        m_kmsState.addVolatileProperty(conn->m_propIDs.link_status);
+
+    const std::lock_guard<std::mutex> lock { m_kmsState.mutex() };
+    m_kmsState.clear();
+
+    auto seed = [this](UInt32 id, UInt32 type)
+    {
+        drmModeObjectPropertiesPtr props { drmModeObjectGetProperties(fd(), id, type) };
+
+        if (!props)
+            return;
+
+        for (UInt32 i = 0; i < props->count_props; i++)
+            m_kmsState.set(id, props->props[i], props->prop_values[i]);
+
+        drmModeFreeObjectProperties(props);
+    };
+
+    for (auto *crtc : m_crtcs)
+        seed(crtc->id(), DRM_MODE_OBJECT_CRTC);
+
+    for (auto *plane : m_planes)
+        seed(plane->id(), DRM_MODE_OBJECT_PLANE);
+
+    for (auto *conn : m_connectors)
+        seed(conn->id(), DRM_MODE_OBJECT_CONNECTOR);
+}
+
 bool SRMDevice::initClientCaps() noexcept
 {
     const char *envStereo3D { getenv("CZ_SRM_ENABLE_STEREO_3D") };
@@ -328,6 +393,16 @@ bool SRMDevice::initCaps() noexcept
     m_caps.TimestampMonotonic = value == 1;
     m_clock = m_caps.TimestampMonotonic ? CLOCK_MONOTONIC : CLOCK_REALTIME;
 
+    value = 0;
+    drmGetCap(fd(), DRM_CAP_CRTC_IN_VBLANK_EVENT, &value);
+    m_caps.CrtcInVBlankEvent = value == 1;
+
+    value = 0;
+    m_caps.CursorWidth = drmGetCap(fd(), DRM_CAP_CURSOR_WIDTH, &value) == 0 && value > 0 ? value : 64;
+
+    value = 0;
+    m_caps.CursorHeight = drmGetCap(fd(), DRM_CAP_CURSOR_HEIGHT, &value) == 0 && value > 0 ? value : 64;
+
     value = 0;
     drmGetCap(fd(), DRM_CAP_ASYNC_PAGE_FLIP, &value);
     m_caps.AsyncPageFlip = value == 1;
@@ -424,6 +499,9 @@ bool SRMDevice::dispatchHotplugEvents() noexcept
 
     m_rescanConnectors = false;
 
+    // Hotplugs may come with changes made by the kernel (e.g. link-status or a CRTC disabled by the driver)
+    initKMSState();
+
     for (auto *conn : connectors())
     {
         drmModeConnectorPtr res { drmModeGetConnector(fd(), conn->id()) };
@@ -438,6 +516,10 @@ bool SRMDevice::dispatchHotplugEvents() noexcept
 
         if (conn->isConnected() != isConnected)
         {
+            // Bandwidth and clock limits may have changed
+            for (auto *crtc : crtcs())
+                crtc->m_testCache.clear();
+
             if (isConnected)
             {
                 conn->updateProperties(res);
@@ -3,6 +3,11 @@
 
 #include <CZ/SRM/SRMObject.h>
 #include <CZ/SRM/SRMLease.h>
+#include <CZ/SRM/SRMEventReactor.h>
+#include <CZ/SRM/SRMKMSState.h>
+#include <CZ/SRM/SRMBlobCache.h>
+#include <CZ/SRM/SRMFramebufferCache.h>
+#include <CZ/SRM/SRMSwapchainPool.h>
 #include <CZ/SRM/SRMLog.h>
 #include <CZ/Ream/RDevice.h>
 #include <CZ/Core/CZBitset.h>
@@ -76,6 +81,20 @@ public:
          * @return true if the DRM device reports vblank timestamps with CLOCK_MONOTONIC, false if it uses CLOCK_REALTIME.
          */
         bool TimestampMonotonic;
+
+        /**
+         * @brief Driver's support for reporting the CRTC id in page flip events.
+         *
+         * Required to route the events of commits affecting multiple CRTCs (@ref SRMCommitGroup).
+         */
+        bool CrtcInVBlankEvent;
+
+        /**
+         * @brief Maximum hardware cursor size reported by the driver (`DRM_CAP_CURSOR_WIDTH/HEIGHT`).
+         *
+         * Defaults to 64x64 if not reported.
+         */
+        UInt32 CursorWidth, CursorHeight;
     };
 
     /**
@@ -164,6 +183,29 @@ public:
 
     RDevice *reamDevice() const noexcept { return m_reamDevice; }
 
+    /**
+     * @brief Last committed value of a KMS object property.
+     *
+     * With the atomic API SRM mirrors the committed state of the device, so no ioctl is performed.
+     * Objects leased to other clients may be outdated.
+     *
+     * @return false if unknown or if the device uses the legacy API.
+     */
+    bool committedProperty(UInt32 objectId, UInt32 propertyId, UInt64 *value) const noexcept
+    {
+        return m_kmsState.get(objectId, propertyId, value);
+    }
+
+    /**
+     * @brief Framebuffers of client images used for direct scanout and overlay planes.
+     */
+    SRMFramebufferCache &framebufferCache() noexcept { return m_fbCache; }
+
+    /**
+     * @brief Idle swapchain buffers shared by the connectors of the device.
+     */
+    SRMSwapchainPool &swapchainPool() noexcept { return m_swapchainPool; }
+
     ~SRMDevice() noexcept;
 
     CZLogger log { SRMLog };
@@ -173,6 +215,8 @@ private:
     friend class SRMRenderer;
     friend class SRMConnector;
     friend class SRMLease;
+    friend class SRMAtomicRequest;
+    friend class SRMPropertyBlob;
     static SRMDevice *Make(SRMCore *core, const char *nodePath, bool isBootVGA) noexcept;
     static SRMDevice *Make(SRMCore *core, int fd) noexcept;
     SRMDevice(SRMCore *core, const char *nodePath, bool isBootVGA) noexcept;
@@ -184,6 +228,9 @@ private:
     bool initPlanes() noexcept;
     bool initConnectors(drmModeResPtr res) noexcept;
 
+    // Seeds m_kmsState from the current kernel state (atomic only)
+    void initKMSState() noexcept;
+
     bool dispatchHotplugEvents() noexcept;
 
     enum class PDriver
@@ -211,11 +258,17 @@ private:
 
     std::vector<SRMConnector*> m_connectors;
     std::vector<SRMPlane*> m_planes;
+    std::mutex m_overlayPlanesMutex; // Overlay planes are claimed by render threads
     std::vector<SRMCrtc*> m_crtcs;
     std::vector<SRMEncoder*> m_encoders;
 
-    // Prevents multiple calls to drmModeHandleEvent
-    std::recursive_mutex m_pageFlipMutex;
+    SRMKMSState m_kmsState;
+    SRMBlobCache m_blobCache { this };
+    SRMFramebufferCache m_fbCache { this };
+    SRMSwapchainPool m_swapchainPool { this };
+
+    // Dispatches DRM events, created after the fd is opened
+    std::unique_ptr<SRMEventReactor> m_reactor;
 };
 
 #endif // SRMDEVICE_H
@@ -0,0 +1,200 @@
+#include <CZ/SRM/SRMEventReactor.h>
+#include <CZ/SRM/SRMRenderer.h>
+#include <CZ/SRM/SRMDevice.h>
+#include <CZ/SRM/SRMCrtc.h>
+#include <CZ/SRM/SRMLog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+using namespace CZ;
+
+// drmEventContext has no user data, the handler runs on the reactor thread
+static thread_local SRMEventReactor *CurrentReactor {};
+
+std::unique_ptr<SRMEventReactor> SRMEventReactor::Make(SRMDevice *device) noexcept
+{
+    const int epollFd { epoll_create1(EPOLL_CLOEXEC) };
+
+    if (epollFd < 0)
+    {
+        SRMLog(CZError, CZLN, "epoll_create1 failed: {}", strerror(errno));
+        return {};
+    }
+
+    const int wakeFd { eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK) };
+
+    if (wakeFd < 0)
+    {
+        SRMLog(CZError, CZLN, "eventfd failed: {}", strerror(errno));
+        close(epollFd);
+        return {};
+    }
+
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = device->fd();
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, device->fd(), &ev) != 0)
+        goto fail;
+
+    ev.data.fd = wakeFd;
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != 0)
+        goto fail;
+
+    return std::unique_ptr<SRMEventReactor>(new SRMEventReactor(device, epollFd, wakeFd));
+
+fail:
+    SRMLog(CZError, CZLN, "epoll_ctl failed: {}", strerror(errno));
+    close(wakeFd);
+    close(epollFd);
+    return {};
+}
+
+SRMEventReactor::SRMEventReactor(SRMDevice *device, int epollFd, int wakeFd) noexcept :
+    m_device(device),
+    m_epollFd(epollFd),
+    m_wakeFd(wakeFd)
+{
+    m_thread = std::thread(&SRMEventReactor::run, this);
+}
+
+SRMEventReactor::~SRMEventReactor() noexcept
+{
+    m_finish = true;
+    const UInt64 one { 1 };
+
+    if (write(m_wakeFd, &one, sizeof(one)) != sizeof(one))
+        SRMLog(CZError, CZLN, "Failed to wake the reactor thread: {}", strerror(errno));
+
+    m_thread.join();
+    close(m_wakeFd);
+    close(m_epollFd);
+}
+
+void SRMEventReactor::attach(UInt32 crtcId, FlipQueue *queue, std::binary_semaphore *wake) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_routesMutex };
+    std::erase_if(m_routes, [crtcId](const Route &route){ return route.crtcId == crtcId; });
+    m_routes.emplace_back(crtcId, queue, wake);
+}
+
+void SRMEventReactor::detach(UInt32 crtcId) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_routesMutex };
+    std::erase_if(m_routes, [crtcId](const Route &route){ return route.crtcId == crtcId; });
+}
+
+UInt64 SRMEventReactor::flipCount(std::span<const UInt32> crtcIds) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_flipMutex };
+    return flipCountLocked(crtcIds);
+}
+
+bool SRMEventReactor::waitFlip(std::span<const UInt32> crtcIds, UInt64 count, std::chrono::steady_clock::time_point deadline) noexcept
+{
+    std::unique_lock<std::mutex> lock { m_flipMutex };
+    return m_flipCond.wait_until(lock, deadline, [&]{ return flipCountLocked(crtcIds) != count; });
+}
+
+UInt64 SRMEventReactor::flipCountLocked(std::span<const UInt32> crtcIds) const noexcept
+{
+    if (crtcIds.empty())
+        return m_flipTotal;
+
+    UInt64 count { 0 };
+
+    for (const auto &[crtcId, n] : m_flipCounts)
+        if (std::find(crtcIds.begin(), crtcIds.end(), crtcId) != crtcIds.end())
+            count += n;
+
+    return count;
+}
+
+void SRMEventReactor::notifyFlip(UInt32 crtcId) noexcept
+{
+    {
+        const std::lock_guard<std::mutex> lock { m_flipMutex };
+        m_flipTotal++;
+
+        auto it { std::find_if(m_flipCounts.begin(), m_flipCounts.end(), [crtcId](const auto &entry){ return entry.first == crtcId; }) };
+
+        if (it == m_flipCounts.end())
+            m_flipCounts.emplace_back(crtcId, 1);
+        else
+            it->second++;
+    }
+
+    m_flipCond.notify_all();
+}
+
+void SRMEventReactor::PageFlipHandler(int fd, UInt32 seq, UInt32 sec, UInt32 usec, UInt32 crtcId, void *data) noexcept
+{
+    CZ_UNUSED(fd);
+
+    // Kernels without DRM_CAP_CRTC_IN_VBLANK_EVENT report 0
+    if (crtcId == 0 && data)
+        crtcId = static_cast<SRMRenderer::Frame*>(data)->rend->crtc->id();
+
+    if (data)
+    {
+        for (auto &route : CurrentReactor->m_routes)
+        {
+            if (route.crtcId != crtcId)
+                continue;
+
+            if (!route.queue->push({ seq, sec, usec, data }))
+                CurrentReactor->m_device->log(CZError, CZLN, "Flip queue of CRTC {} is full, event dropped", crtcId);
+
+            route.wake->release();
+            break;
+        }
+    }
+
+    // The CRTC is no longer busy, wake commits waiting to retry
+    CurrentReactor->notifyFlip(crtcId);
+}
+
+void SRMEventReactor::run() noexcept
+{
+    CurrentReactor = this;
+
+    drmEventContext ctx {};
+    ctx.version = DRM_EVENT_CONTEXT_VERSION;
+    ctx.page_flip_handler2 = &PageFlipHandler;
+
+    epoll_event events[2];
+
+    while (!m_finish)
+    {
+        const int n { epoll_wait(m_epollFd, events, 2, -1) };
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            m_device->log(CZError, CZLN, "epoll_wait failed: {}", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == m_wakeFd)
+            {
+                UInt64 val;
+                [[maybe_unused]] const auto ret { read(m_wakeFd, &val, sizeof(val)) };
+                continue;
+            }
+
+            const std::lock_guard<std::mutex> lock { m_routesMutex };
+            drmHandleEvent(m_device->fd(), &ctx);
+        }
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef SRMEVENTREACTOR_H
+#define SRMEVENTREACTOR_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <span>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Per-device DRM event thread.
+ *
+ * Owns the reading end of the DRM fd through epoll and dispatches page flip events
+ * (page_flip_handler2) to the queue of the CRTC that generated them. Render threads
+ * only block on their own queue, so they never poll the shared fd or contend for it.
+ *
+ * @note This class is primarily used by SRM internally.
+ */
+class CZ::SRMEventReactor final : public SRMObject
+{
+public:
+    struct FlipEvent
+    {
+        UInt32 seq, sec, usec;
+        void *data;
+    };
+
+    /**
+     * @brief Lock-free single-producer (reactor) single-consumer (render thread) queue.
+     */
+    class FlipQueue
+    {
+    public:
+        bool push(const FlipEvent &event) noexcept
+        {
+            const UInt32 tail { m_tail.load(std::memory_order_relaxed) };
+            const UInt32 next { (tail + 1) % Capacity };
+
+            if (next == m_head.load(std::memory_order_acquire))
+                return false;
+
+            m_events[tail] = event;
+            m_tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(FlipEvent *event) noexcept
+        {
+            const UInt32 head { m_head.load(std::memory_order_relaxed) };
+
+            if (head == m_tail.load(std::memory_order_acquire))
+                return false;
+
+            *event = m_events[head];
+            m_head.store((head + 1) % Capacity, std::memory_order_release);
+            return true;
+        }
+    private:
+        static constexpr UInt32 Capacity { 16 };
+        std::array<FlipEvent, Capacity> m_events {};
+        std::atomic<UInt32> m_head {}, m_tail {};
+    };
+
+    static std::unique_ptr<SRMEventReactor> Make(SRMDevice *device) noexcept;
+    ~SRMEventReactor() noexcept;
+
+    /**
+     * @brief Routes the flip events of a CRTC.
+     *
+     * Each event is pushed into queue and then wake is released.
+     */
+    void attach(UInt32 crtcId, FlipQueue *queue, std::binary_semaphore *wake) noexcept;
+
+    /**
+     * @brief Stops routing events of a CRTC.
+     *
+     * Once it returns the reactor no longer references the queue nor the semaphore.
+     */
+    void detach(UInt32 crtcId) noexcept;
+
+    /**
+     * @brief Number of flip events received for the given CRTCs, or for all CRTCs if crtcIds is empty.
+     *
+     * Counts every completion, including those of commits without a route or user data.
+     */
+    UInt64 flipCount(std::span<const UInt32> crtcIds) noexcept;
+
+    /**
+     * @brief Blocks until flipCount(crtcIds) differs from count or the deadline is reached.
+     *
+     * @return false on timeout.
+     */
+    bool waitFlip(std::span<const UInt32> crtcIds, UInt64 count, std::chrono::steady_clock::time_point deadline) noexcept;
+private:
+    struct Route
+    {
+        UInt32 crtcId;
+        FlipQueue *queue;
+        std::binary_semaphore *wake;
+    };
+
+    SRMEventReactor(SRMDevice *device, int epollFd, int wakeFd) noexcept;
+    static void PageFlipHandler(int fd, UInt32 seq, UInt32 sec, UInt32 usec, UInt32 crtcId, void *data) noexcept;
+    void run() noexcept;
+    void notifyFlip(UInt32 crtcId) noexcept;
+    UInt64 flipCountLocked(std::span<const UInt32> crtcIds) const noexcept;
+
+    SRMDevice *m_device;
+    int m_epollFd;
+    int m_wakeFd;
+    std::thread m_thread;
+    std::atomic<bool> m_finish {};
+
+    // Locked while dispatching, routes are rarely modified
+    std::mutex m_routesMutex;
+    std::vector<Route> m_routes;
+
+    // Flip completions, waited on by commits that got EBUSY
+    std::mutex m_flipMutex;
+    std::condition_variable m_flipCond;
+    std::vector<std::pair<UInt32, UInt64>> m_flipCounts; // CRTC id, count
+    UInt64 m_flipTotal {};
+};
+
+#endif // SRMEVENTREACTOR_H
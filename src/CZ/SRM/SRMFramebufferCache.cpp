@@ -0,0 +1,188 @@
+#include <CZ/SRM/SRMFramebufferCache.h>
+#include <CZ/SRM/SRMDevice.h>
+#include <CZ/Ream/RImage.h>
+#include <CZ/Ream/DRM/RDRMFramebuffer.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+using namespace CZ;
+
+std::shared_ptr<RDRMFramebuffer> SRMFramebufferCache::get(std::shared_ptr<RImage> image, RFormat format, Layout *layout) noexcept
+{
+    if (!image)
+        return {};
+
+    const RModifier modifier { image->modifier() };
+    const SkISize size { image->size() };
+
+    const std::lock_guard<std::mutex> lock { m_mutex };
+
+    for (auto &entry : m_entries)
+    {
+        // The address may be reused by a new image once the old one is destroyed
+        if (entry.key != image.get() || entry.image.expired())
+            continue;
+
+        if (entry.format == format && entry.modifier == modifier && entry.size == size)
+        {
+            entry.lastUse = ++m_useCounter;
+            m_stats.hits++;
+
+            if (layout)
+                *layout = entry.layout;
+
+            return entry.fb;
+        }
+    }
+
+    m_stats.misses++;
+
+    Layout fbLayout {};
+    auto fb { import(image, format, &fbLayout) };
+
+    if (!fb)
+        return {};
+
+    Entry &entry { m_entries.emplace_back() };
+    entry.image = image;
+    entry.key = image.get();
+    entry.format = format;
+    entry.modifier = modifier;
+    entry.size = size;
+    entry.bytes = static_cast<UInt64>(size.width()) * static_cast<UInt64>(size.height()) * 4;
+    entry.lastUse = ++m_useCounter;
+    entry.fb = fb;
+    entry.layout = fbLayout;
+    m_bytes += entry.bytes;
+    prune();
+
+    if (layout)
+        *layout = fbLayout;
+
+    return fb;
+}
+
+std::shared_ptr<RDRMFramebuffer> SRMFramebufferCache::import(std::shared_ptr<RImage> image, RFormat format, Layout *layout) noexcept
+{
+    auto fb { image->drmFb(m_device->reamDevice()) };
+
+    if (!fb)
+        return {};
+
+    drmModeFB2Ptr info { drmModeGetFB2(m_device->fd(), fb->id()) };
+
+    if (!info)
+    {
+        m_device->log(CZError, CZLN, "Failed to query framebuffer {} (drmModeGetFB2)", fb->id());
+        return {};
+    }
+
+    layout->planeCount = 0;
+
+    for (UInt32 i = 0; i < 4; i++)
+    {
+        layout->pitches[i] = info->pitches[i];
+        layout->offsets[i] = info->offsets[i];
+
+        if (info->pitches[i] != 0)
+            layout->planeCount++;
+    }
+
+    // Same memory, scanned out with another format (e.g. the opaque variant of an alpha format)
+    if (format != image->formatInfo().format)
+    {
+        UInt32 id { 0 };
+        int ret { -EACCES };
+
+        // Handles are only returned to the DRM master
+        if (info->handles[0] != 0)
+        {
+            UInt64 modifiers[4] {};
+
+            for (UInt32 i = 0; i < layout->planeCount; i++)
+                modifiers[i] = info->modifier;
+
+            ret = drmModeAddFB2WithModifiers(m_device->fd(), info->width, info->height, format,
+                info->handles, info->pitches, info->offsets, modifiers, &id,
+                (info->flags & DRM_MODE_FB_MODIFIERS) ? DRM_MODE_FB_MODIFIERS : 0);
+        }
+
+        // drmModeGetFB2 opened new handles, close each one once
+        for (UInt32 i = 0; i < 4; i++)
+        {
+            if (info->handles[i] == 0 || std::find(info->handles, info->handles + i, info->handles[i]) != info->handles + i)
+                continue;
+
+            drmCloseBufferHandle(m_device->fd(), info->handles[i]);
+        }
+
+        if (ret == 0)
+        {
+            fb = RDRMFramebuffer::Wrap(id, m_device->reamDevice(), CZOwn::Own);
+
+            if (!fb)
+                drmModeRmFB(m_device->fd(), id);
+        }
+        else
+        {
+            m_device->log(CZTrace, CZLN, "Failed to create framebuffer with format {}: {}", RDRMFormat::FormatName(format), strerror(-ret));
+            fb.reset();
+        }
+    }
+
+    drmModeFreeFB2(info);
+    return fb;
+}
+
+void SRMFramebufferCache::prune() noexcept
+{
+    for (size_t i = 0; i < m_entries.size();)
+    {
+        if (m_entries[i].image.expired())
+        {
+            m_bytes -= m_entries[i].bytes;
+            std::swap(m_entries[i], m_entries.back());
+            m_entries.pop_back();
+            m_stats.evictions++;
+        }
+        else
+            i++;
+    }
+
+    // Always keep the most recent entry, even if it exceeds the cap alone
+    while (m_bytes > m_maxBytes && m_entries.size() > 1)
+    {
+        auto lru { std::min_element(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) {
+            return a.lastUse < b.lastUse;
+        })};
+
+        m_bytes -= lru->bytes;
+        std::swap(*lru, m_entries.back());
+        m_entries.pop_back();
+        m_stats.evictions++;
+    }
+}
+
+void SRMFramebufferCache::clear() noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    m_entries.clear();
+    m_bytes = 0;
+}
+
+void SRMFramebufferCache::setMaxBytes(UInt64 bytes) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    m_maxBytes = bytes;
+    prune();
+}
+
+SRMFramebufferCache::Stats SRMFramebufferCache::stats() const noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    return m_stats;
+}
@@ -0,0 +1,97 @@
+#ifndef SRMFRAMEBUFFERCACHE_H
+#define SRMFRAMEBUFFERCACHE_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <CZ/Ream/Ream.h>
+#include <CZ/skia/core/SkSize.h>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Per-device LRU cache of DRM framebuffers for client images.
+ *
+ * Clients cycle through a few buffers, so direct scanout (SRMConnector::setCustomScanoutImage()) and
+ * overlay planes (SRMConnector::setOverlayLayers()) look their framebuffers up here instead of importing
+ * them every frame. Entries are keyed by image identity, scanout format, modifier and size, and are dropped
+ * once the image is destroyed or when the memory cap is exceeded.
+ */
+class CZ::SRMFramebufferCache final : public SRMObject
+{
+public:
+    struct Stats
+    {
+        UInt64 hits;
+        UInt64 misses;
+        UInt64 evictions;
+    };
+
+    // Memory layout of a framebuffer as reported by the kernel
+    struct Layout
+    {
+        UInt32 planeCount;
+        std::array<UInt32, 4> pitches;
+        std::array<UInt32, 4> offsets;
+    };
+
+    SRMFramebufferCache(SRMDevice *device) noexcept : m_device(device) {}
+
+    /**
+     * @brief Returns the framebuffer of the image, importing it on a miss.
+     *
+     * @param format Format the framebuffer is created with. It can differ from the image's format to
+     *               scan out an alpha format as its opaque variant (e.g. ARGB8888 as XRGB8888).
+     * @param layout If not nullptr, filled with the pitches and offsets of the framebuffer.
+     *
+     * @return nullptr if the image can't be imported by the device.
+     */
+    std::shared_ptr<RDRMFramebuffer> get(std::shared_ptr<RImage> image, RFormat format, Layout *layout = nullptr) noexcept;
+
+    /**
+     * @brief Destroys all entries, framebuffers still referenced elsewhere remain valid.
+     */
+    void clear() noexcept;
+
+    /**
+     * @brief Sets the max estimated memory referenced by the cache, in bytes.
+     *
+     * Sizes are estimated at 4 bytes per pixel. Defaults to 256 MiB.
+     */
+    void setMaxBytes(UInt64 bytes) noexcept;
+    UInt64 maxBytes() const noexcept { return m_maxBytes; }
+
+    /**
+     * @brief Hit, miss and eviction counters since the device was created.
+     */
+    Stats stats() const noexcept;
+private:
+    struct Entry
+    {
+        std::weak_ptr<RImage> image;
+        const RImage *key;
+        RFormat format; // Of the framebuffer
+        RModifier modifier;
+        SkISize size;
+        UInt64 bytes;
+        UInt64 lastUse;
+        std::shared_ptr<RDRMFramebuffer> fb;
+        Layout layout;
+    };
+
+    // Imports the image with the given format, nullptr on failure
+    std::shared_ptr<RDRMFramebuffer> import(std::shared_ptr<RImage> image, RFormat format, Layout *layout) noexcept;
+
+    // Drops entries of destroyed images and the least recently used ones until under the cap
+    void prune() noexcept;
+
+    SRMDevice *m_device;
+    std::vector<Entry> m_entries;
+    UInt64 m_bytes {};
+    UInt64 m_maxBytes { 256 * 1024 * 1024 };
+    UInt64 m_useCounter {};
+    Stats m_stats {};
+    mutable std::mutex m_mutex;
+};
+
+#endif // SRMFRAMEBUFFERCACHE_H
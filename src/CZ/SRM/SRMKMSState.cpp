@@ -0,0 +1,49 @@
+#include <CZ/SRM/SRMKMSState.h>
+
+#include <algorithm>
+
+using namespace CZ;
+
+bool SRMKMSState::get(UInt32 objectId, UInt32 propertyId, UInt64 *value) const noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    const auto it { m_values.find(Key(objectId, propertyId)) };
+
+    if (it == m_values.end())
+        return false;
+
+    *value = it->second;
+    return true;
+}
+
+void SRMKMSState::addVolatileProperty(UInt32 propertyId) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+
+    if (propertyId != 0 && !isVolatile(propertyId))
+        m_volatile.emplace_back(propertyId);
+}
+
+bool SRMKMSState::isVolatile(UInt32 propertyId) const noexcept
+{
+    return std::find(m_volatile.begin(), m_volatile.end(), propertyId) != m_volatile.end();
+}
+
+bool SRMKMSState::matches(UInt32 objectId, UInt32 propertyId, UInt64 value) const noexcept
+{
+    if (isVolatile(propertyId))
+        return false;
+
+    const auto it { m_values.find(Key(objectId, propertyId)) };
+    return it != m_values.end() && it->second == value;
+}
+
+void SRMKMSState::set(UInt32 objectId, UInt32 propertyId, UInt64 value) noexcept
+{
+    m_values[Key(objectId, propertyId)] = value;
+}
+
+void SRMKMSState::clear() noexcept
+{
+    m_values.clear();
+}
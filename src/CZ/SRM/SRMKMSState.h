@@ -0,0 +1,49 @@
+#ifndef SRMKMSSTATE_H
+#define SRMKMSSTATE_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief In-memory mirror of the committed KMS property values of a device.
+ *
+ * Seeded from the kernel when the device is opened or resumed, and updated after each
+ * successful atomic commit. Atomic requests use it to skip properties whose value
+ * wouldn't change.
+ *
+ * @note This class is primarily used by SRM internally, see SRMDevice::committedProperty().
+ */
+class CZ::SRMKMSState final : public SRMObject
+{
+public:
+    /**
+     * @brief Last committed value of a property.
+     *
+     * @return false if unknown.
+     */
+    bool get(UInt32 objectId, UInt32 propertyId, UInt64 *value) const noexcept;
+
+    // Per-commit values such as IN_FENCE_FD, never skipped
+    void addVolatileProperty(UInt32 propertyId) noexcept;
+
+    // The methods below must be called with mutex() locked
+
+    bool isVolatile(UInt32 propertyId) const noexcept;
+    bool matches(UInt32 objectId, UInt32 propertyId, UInt64 value) const noexcept;
+    void set(UInt32 objectId, UInt32 propertyId, UInt64 value) noexcept;
+    void clear() noexcept;
+    std::mutex &mutex() const noexcept { return m_mutex; }
+private:
+    static UInt64 Key(UInt32 objectId, UInt32 propertyId) noexcept
+    {
+        return (static_cast<UInt64>(objectId) << 32) | propertyId;
+    }
+
+    std::unordered_map<UInt64, UInt64> m_values;
+    std::vector<UInt32> m_volatile;
+    mutable std::mutex m_mutex;
+};
+
+#endif // SRMKMSSTATE_H
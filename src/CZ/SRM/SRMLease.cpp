@@ -25,6 +25,9 @@ SRMLease::~SRMLease() noexcept
     for (auto &r : m_resources.planes)
         if (r) r->m_leased = false;
 
+    // The lessee may have changed the state of the leased objects
+    m_device->initKMSState();
+
     m_device->log(CZTrace, "Lease {} revoked", m_lessee);
 }
 
@@ -0,0 +1,37 @@
+#ifndef SRMOVERLAYLAYER_H
+#define SRMOVERLAYLAYER_H
+
+#include <CZ/SRM/SRM.h>
+#include <CZ/Ream/Ream.h>
+#include <CZ/skia/core/SkRect.h>
+
+namespace CZ
+{
+    /**
+     * @brief Candidate layer for an overlay plane.
+     *
+     * @see SRMConnector::setOverlayLayers()
+     */
+    struct SRMOverlayLayer
+    {
+        /// Buffer to scan out, must be importable as a DRM framebuffer by the connector's device (e.g. a dma-buf)
+        std::shared_ptr<RImage> image;
+
+        /// Region of the image to display, in buffer pixels
+        SkRect srcRect;
+
+        /// Position and size in connector pixels, scaling support depends on the hardware
+        SkIRect dstRect;
+
+        /// Stacking order among the assigned layers (higher on top), all of them are placed above the primary plane
+        Int32 zOrder {};
+
+        /// Plane opacity in the range [0, 1], values below 1 require planes with the `alpha` property
+        Float32 alpha { 1.f };
+
+        /// Set by SRMConnector::setOverlayLayers(), if false the layer must be composited by the caller
+        bool assigned {};
+    };
+};
+
+#endif // SRMOVERLAYLAYER_H
@@ -0,0 +1,338 @@
+#include <CZ/SRM/SRMPixelTransfer.h>
+#include <CZ/SRM/SRMLog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <drm_fourcc.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SRM_TRANSFER_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define SRM_TRANSFER_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace CZ;
+
+// Below this amount of pixels waking the workers costs more than the copy
+static constexpr Int64 MinParallelPixels { 256 * 256 };
+
+static inline void StoreFence() noexcept
+{
+#if SRM_TRANSFER_X86
+    _mm_sfence();
+#endif
+}
+
+template<bool swap, bool fill>
+static inline void PixelScalar(const UInt8 *src, UInt8 *dst) noexcept
+{
+    UInt32 p;
+    memcpy(&p, src, 4);
+
+    if constexpr (swap)
+        p = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+
+    if constexpr (fill)
+        p |= 0xFF000000;
+
+    memcpy(dst, &p, 4);
+}
+
+template<bool swap, bool fill>
+static void RowScalar(const UInt8 *src, UInt8 *dst, UInt32 n) noexcept
+{
+    if constexpr (!swap && !fill)
+    {
+        memcpy(dst, src, n * 4);
+        return;
+    }
+
+    for (; n > 0; n--, src += 4, dst += 4)
+        PixelScalar<swap, fill>(src, dst);
+}
+
+#if SRM_TRANSFER_X86
+
+template<bool swap, bool fill>
+static void RowSSE2(const UInt8 *src, UInt8 *dst, UInt32 n) noexcept
+{
+    // Streaming stores require 16 byte aligned destinations
+    for (; n > 0 && (reinterpret_cast<uintptr_t>(dst) & 15); n--, src += 4, dst += 4)
+        PixelScalar<swap, fill>(src, dst);
+
+    const __m128i alpha { _mm_set1_epi32(static_cast<int>(0xFF000000)) };
+    const __m128i ga { _mm_set1_epi32(static_cast<int>(0xFF00FF00)) };
+    const __m128i rb { _mm_set1_epi32(0x00FF00FF) };
+
+    for (; n >= 4; n -= 4, src += 16, dst += 16)
+    {
+        __m128i v { _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)) };
+
+        if constexpr (swap)
+        {
+            const __m128i t { _mm_and_si128(v, rb) };
+            v = _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(_mm_slli_epi32(t, 16), _mm_srli_epi32(t, 16)));
+        }
+
+        if constexpr (fill)
+            v = _mm_or_si128(v, alpha);
+
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst), v);
+    }
+
+    for (; n > 0; n--, src += 4, dst += 4)
+        PixelScalar<swap, fill>(src, dst);
+}
+
+template<bool swap, bool fill>
+__attribute__((target("avx2")))
+static void RowAVX2(const UInt8 *src, UInt8 *dst, UInt32 n) noexcept
+{
+    for (; n > 0 && (reinterpret_cast<uintptr_t>(dst) & 31); n--, src += 4, dst += 4)
+        PixelScalar<swap, fill>(src, dst);
+
+    const __m256i alpha { _mm256_set1_epi32(static_cast<int>(0xFF000000)) };
+    const __m256i shuffle { _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15) };
+
+    for (; n >= 8; n -= 8, src += 32, dst += 32)
+    {
+        __m256i v { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)) };
+
+        if constexpr (swap)
+            v = _mm256_shuffle_epi8(v, shuffle);
+
+        if constexpr (fill)
+            v = _mm256_or_si256(v, alpha);
+
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), v);
+    }
+
+    for (; n > 0; n--, src += 4, dst += 4)
+        PixelScalar<swap, fill>(src, dst);
+}
+
+#elif SRM_TRANSFER_NEON
+
+// NEON has no non-temporal store intrinsics, plain stores are used
+template<bool swap, bool fill>
+static void RowNEON(const UInt8 *src, UInt8 *dst, UInt32 n) noexcept
+{
+    if constexpr (!swap && !fill)
+    {
+        memcpy(dst, src, n * 4);
+        return;
+    }
+
+    for (; n >= 16; n -= 16, src += 64, dst += 64)
+    {
+        uint8x16x4_t v { vld4q_u8(src) };
+
+        if constexpr (swap)
+            std::swap(v.val[0], v.val[2]);
+
+        if constexpr (fill)
+            v.val[3] = vdupq_n_u8(0xFF);
+
+        vst4q_u8(dst, v);
+    }
+
+    for (; n > 0; n--, src += 4, dst += 4)
+        PixelScalar<swap, fill>(src, dst);
+}
+
+#endif
+
+std::unique_ptr<SRMPixelTransfer> SRMPixelTransfer::Make(UInt32 threads) noexcept
+{
+    if (threads == 0)
+        threads = std::clamp(std::thread::hardware_concurrency() / 2, 1U, 4U);
+
+    return std::unique_ptr<SRMPixelTransfer>(new SRMPixelTransfer(threads));
+}
+
+SRMPixelTransfer::SRMPixelTransfer(UInt32 threads) noexcept
+{
+#if SRM_TRANSFER_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        m_funcs[Copy] = &RowAVX2<false, false>;
+        m_funcs[CopyFillAlpha] = &RowAVX2<false, true>;
+        m_funcs[SwapRB] = &RowAVX2<true, false>;
+        m_funcs[SwapRBFillAlpha] = &RowAVX2<true, true>;
+        m_stats.isa = "avx2";
+    }
+    else
+    {
+        m_funcs[Copy] = &RowSSE2<false, false>;
+        m_funcs[CopyFillAlpha] = &RowSSE2<false, true>;
+        m_funcs[SwapRB] = &RowSSE2<true, false>;
+        m_funcs[SwapRBFillAlpha] = &RowSSE2<true, true>;
+        m_stats.isa = "sse2";
+    }
+#elif SRM_TRANSFER_NEON
+    m_funcs[Copy] = &RowNEON<false, false>;
+    m_funcs[CopyFillAlpha] = &RowNEON<false, true>;
+    m_funcs[SwapRB] = &RowNEON<true, false>;
+    m_funcs[SwapRBFillAlpha] = &RowNEON<true, true>;
+    m_stats.isa = "neon";
+#else
+    m_funcs[Copy] = &RowScalar<false, false>;
+    m_funcs[CopyFillAlpha] = &RowScalar<false, true>;
+    m_funcs[SwapRB] = &RowScalar<true, false>;
+    m_funcs[SwapRBFillAlpha] = &RowScalar<true, true>;
+    m_stats.isa = "scalar";
+#endif
+
+    m_stats.threads = threads;
+    m_workers.reserve(threads - 1);
+
+    for (UInt32 i = 1; i < threads; i++)
+        m_workers.emplace_back(&SRMPixelTransfer::workerLoop, this);
+}
+
+SRMPixelTransfer::~SRMPixelTransfer() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_finish = true;
+    }
+
+    m_jobCond.notify_all();
+
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+bool SRMPixelTransfer::GetKernel(RFormat src, RFormat dst, Kernel *kernel) noexcept
+{
+    // Little-endian byte order: XRGB = B,G,R,X and XBGR = R,G,B,X
+    auto info = [](RFormat format, bool *bgr, bool *alpha) -> bool
+    {
+        switch (format)
+        {
+        case DRM_FORMAT_XRGB8888: *bgr = true;  *alpha = false; return true;
+        case DRM_FORMAT_ARGB8888: *bgr = true;  *alpha = true;  return true;
+        case DRM_FORMAT_XBGR8888: *bgr = false; *alpha = false; return true;
+        case DRM_FORMAT_ABGR8888: *bgr = false; *alpha = true;  return true;
+        default: return false;
+        }
+    };
+
+    bool srcBGR, srcAlpha, dstBGR, dstAlpha;
+
+    if (!info(src, &srcBGR, &srcAlpha) || !info(dst, &dstBGR, &dstAlpha))
+        return false;
+
+    const bool fill { dstAlpha && !srcAlpha };
+
+    if (srcBGR == dstBGR)
+        *kernel = fill ? CopyFillAlpha : Copy;
+    else
+        *kernel = fill ? SwapRBFillAlpha : SwapRB;
+
+    return true;
+}
+
+void SRMPixelTransfer::run(Kernel kernel, const UInt8 *src, UInt32 srcStride, UInt8 *dst, UInt32 dstStride, const SkRegion &region) noexcept
+{
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const UInt32 threads { static_cast<UInt32>(m_workers.size()) + 1 };
+    Int64 pixels { 0 };
+
+    m_bands.clear();
+
+    for (SkRegion::Iterator it(region); !it.done(); it.next())
+    {
+        const SkIRect &r { it.rect() };
+        pixels += r.width64() * r.height64();
+
+        // Two bands per thread, so that faster threads can steal work
+        const Int32 bandRows { std::max(8, (r.height() + Int32(threads * 2) - 1) / Int32(threads * 2)) };
+
+        for (Int32 y = r.top(); y < r.bottom(); y += bandRows)
+            m_bands.push_back({ r.left(), y, r.width(), std::min(bandRows, r.bottom() - y) });
+    }
+
+    m_func = m_funcs[kernel];
+    m_src = src;
+    m_dst = dst;
+    m_srcStride = srcStride;
+    m_dstStride = dstStride;
+    m_nextBand = 0;
+
+    if (m_workers.empty() || m_bands.size() <= 1 || pixels < MinParallelPixels)
+        processBands();
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_activeWorkers = m_workers.size();
+            m_jobSerial++;
+        }
+
+        m_jobCond.notify_all();
+        processBands();
+
+        // Wait until no worker can touch the job state
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_doneCond.wait(lock, [this]{ return m_activeWorkers == 0; });
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const UInt64 ns ((end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec));
+
+    m_stats.frames++;
+    m_stats.lastTransferNs = ns;
+    m_stats.lastBytes = pixels * 4;
+    m_stats.maxTransferNs = std::max(m_stats.maxTransferNs, ns);
+    m_stats.avgTransferNs = m_stats.avgTransferNs == 0 ? ns : (m_stats.avgTransferNs * 7 + ns) / 8;
+}
+
+void SRMPixelTransfer::workerLoop() noexcept
+{
+    UInt64 serial { 0 };
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_jobCond.wait(lock, [this, serial]{ return m_finish || m_jobSerial != serial; });
+
+            if (m_finish)
+                return;
+
+            serial = m_jobSerial;
+        }
+
+        processBands();
+
+        std::lock_guard<std::mutex> lock { m_mutex };
+
+        if (--m_activeWorkers == 0)
+            m_doneCond.notify_one();
+    }
+}
+
+void SRMPixelTransfer::processBands() noexcept
+{
+    UInt32 i;
+
+    while ((i = m_nextBand.fetch_add(1, std::memory_order_relaxed)) < m_bands.size())
+    {
+        const Band &band { m_bands[i] };
+        const UInt8 *src { m_src + band.y * m_srcStride + band.x * 4 };
+        UInt8 *dst { m_dst + band.y * m_dstStride + band.x * 4 };
+
+        for (Int32 row = 0; row < band.h; row++, src += m_srcStride, dst += m_dstStride)
+            m_func(src, dst, band.w);
+    }
+
+    // Non-temporal stores are weakly ordered
+    StoreFence();
+}
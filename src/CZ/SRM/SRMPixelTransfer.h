@@ -0,0 +1,110 @@
+#ifndef SRMPIXELTRANSFER_H
+#define SRMPIXELTRANSFER_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <CZ/skia/core/SkRegion.h>
+#include <CZ/Ream/Ream.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Multi-threaded pixel copy stage.
+ *
+ * Used by the Dumb strategy to move a damaged region from a cached staging buffer into
+ * write-combined scanout memory. The region is split into row bands processed by a small
+ * worker pool (the calling thread included), using AVX2, SSE2 or NEON kernels with
+ * non-temporal stores when available.
+ *
+ * Only 32 bit XRGB8888, ARGB8888, XBGR8888 and ABGR8888 conversions are supported.
+ *
+ * @note This class is primarily used by SRM internally.
+ */
+class CZ::SRMPixelTransfer final : public SRMObject
+{
+public:
+    enum Kernel
+    {
+        Copy,               ///< Same channel order
+        CopyFillAlpha,      ///< Same channel order, X to A
+        SwapRB,             ///< Red and blue swapped
+        SwapRBFillAlpha     ///< Red and blue swapped, X to A
+    };
+
+    /**
+     * @brief Per-frame transfer timings.
+     *
+     * Times are in nanoseconds.
+     */
+    struct Stats
+    {
+        UInt64 frames;          ///< Number of transfers
+        UInt64 lastReadbackNs;  ///< Last readback into the staging buffer
+        UInt64 lastTransferNs;  ///< Last copy into the scanout buffer
+        UInt64 avgTransferNs;   ///< Exponential moving average of the copy time
+        UInt64 maxTransferNs;   ///< Slowest copy
+        UInt64 lastBytes;       ///< Bytes written in the last copy
+        UInt32 threads;         ///< Number of threads used, including the caller
+        const char *isa;        ///< "avx2", "sse2", "neon" or "scalar"
+    };
+
+    /**
+     * @brief Creates a transfer stage.
+     *
+     * @param threads Total number of threads including the caller, 0 to choose automatically.
+     */
+    static std::unique_ptr<SRMPixelTransfer> Make(UInt32 threads) noexcept;
+    ~SRMPixelTransfer() noexcept;
+
+    /**
+     * @brief Finds the kernel that converts src into dst.
+     *
+     * @return false if the conversion is not supported.
+     */
+    static bool GetKernel(RFormat src, RFormat dst, Kernel *kernel) noexcept;
+
+    /**
+     * @brief Copies a region between two 32 bit buffers of the same size, blocking until finished.
+     */
+    void run(Kernel kernel, const UInt8 *src, UInt32 srcStride, UInt8 *dst, UInt32 dstStride, const SkRegion &region) noexcept;
+
+    const Stats &stats() const noexcept { return m_stats; }
+    Stats &stats() noexcept { return m_stats; }
+private:
+    using RowFunc = void(*)(const UInt8 *src, UInt8 *dst, UInt32 pixels) noexcept;
+
+    struct Band
+    {
+        Int32 x, y, w, h;
+    };
+
+    SRMPixelTransfer(UInt32 threads) noexcept;
+    void workerLoop() noexcept;
+    void processBands() noexcept;
+
+    Stats m_stats {};
+    std::vector<std::thread> m_workers;
+    std::vector<Band> m_bands;
+
+    // Current job
+    RowFunc m_func {};
+    const UInt8 *m_src {};
+    UInt8 *m_dst {};
+    UInt32 m_srcStride {};
+    UInt32 m_dstStride {};
+    RowFunc m_funcs[4] {};
+    std::atomic<UInt32> m_nextBand {};
+    UInt32 m_activeWorkers {};
+
+    std::mutex m_mutex;
+    std::condition_variable m_jobCond;
+    std::condition_variable m_doneCond;
+    UInt64 m_jobSerial {};
+    bool m_finish {};
+};
+
+#endif // SRMPIXELTRANSFER_H
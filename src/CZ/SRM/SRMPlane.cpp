@@ -67,6 +67,11 @@ bool SRMPlane::initPropIds() noexcept
             m_propIDs.IN_FORMATS = prop->prop_id;
             initInFormats(props->prop_values[i]);
         }
+        else if (strcmp(prop->name, "SIZE_HINTS") == 0)
+        {
+            m_propIDs.SIZE_HINTS = prop->prop_id;
+            initSizeHints(props->prop_values[i]);
+        }
         else if (strcmp(prop->name, "CRTC_ID") == 0)
             m_propIDs.CRTC_ID = prop->prop_id;
         else if (strcmp(prop->name, "CRTC_X") == 0)
@@ -87,6 +92,10 @@ bool SRMPlane::initPropIds() noexcept
             m_propIDs.SRC_H = prop->prop_id;
         else if (strcmp(prop->name, "rotation") == 0)
             m_propIDs.rotation = prop->prop_id;
+        else if (strcmp(prop->name, "alpha") == 0)
+            m_propIDs.alpha = prop->prop_id;
+        else if (strcmp(prop->name, "zpos") == 0 && !(prop->flags & DRM_MODE_PROP_IMMUTABLE))
+            m_propIDs.zpos = prop->prop_id;
         else if (strcmp(prop->name, "type") == 0)
         {
             m_propIDs.type = prop->prop_id;
@@ -126,6 +135,25 @@ void SRMPlane::initInFormats(UInt64 blobId) noexcept
     }
 }
 
+void SRMPlane::initSizeHints(UInt64 blobId) noexcept
+{
+    if (blobId == 0)
+        return;
+
+    drmModePropertyBlobRes *blob { drmModeGetPropertyBlob(device()->fd(), blobId) };
+
+    if (!blob)
+        return;
+
+    // Array of struct drm_plane_size_hint { __u16 width, height; }, not defined by older headers
+    const UInt16 *hints { static_cast<const UInt16*>(blob->data) };
+
+    for (UInt32 i = 0; i + 1 < blob->length / sizeof(UInt16); i += 2)
+        m_sizeHints.emplace_back(SkISize::Make(hints[i], hints[i + 1]));
+
+    drmModeFreePropertyBlob(blob);
+}
+
 bool SRMPlane::initLegacyFormats(drmModePlanePtr res) noexcept
 {
     for (UInt32 i = 0; i < res->count_formats; i++)
@@ -5,6 +5,7 @@
 #include <CZ/Ream/Ream.h>
 #include <CZ/SRM/SRMObject.h>
 #include <CZ/Core/CZWeak.h>
+#include <CZ/skia/core/SkSize.h>
 #include <algorithm>
 #include <string_view>
 #include <unordered_set>
@@ -89,6 +90,13 @@ public:
      */
     const RDRMFormatSet &formats() const noexcept { return m_formats; }
 
+    /**
+     * @brief Recommended plane sizes for cursor-like usage (no scaling), in order of preference.
+     *
+     * Taken from the `SIZE_HINTS` property, empty if the driver doesn't provide it.
+     */
+    const std::vector<SkISize> &sizeHints() const noexcept { return m_sizeHints; }
+
     /**
      * @brief Checks if the CRTC is being leased.
      */
@@ -107,6 +115,7 @@ private:
     {}
     bool initPropIds() noexcept;
     void initInFormats(UInt64 blobId) noexcept;
+    void initSizeHints(UInt64 blobId) noexcept;
     bool initLegacyFormats(drmModePlanePtr res) noexcept;
     bool initCrtcs(drmModePlanePtr res) noexcept;
 
@@ -115,6 +124,7 @@ private:
     CZWeak<SRMConnector> m_currentConnector;
     std::vector<SRMCrtc*> m_crtcs;
     RDRMFormatSet m_formats;
+    std::vector<SkISize> m_sizeHints;
     Type m_type;
     bool m_leased {};
 
@@ -128,6 +138,7 @@ private:
             FB_DAMAGE_CLIPS,
             IN_FORMATS,
             IN_FENCE_FD,
+            SIZE_HINTS,
             CRTC_ID,
             CRTC_X,
             CRTC_Y,
@@ -138,6 +149,8 @@ private:
             SRC_W,
             SRC_H,
             rotation,
+            alpha,
+            zpos, // 0 if immutable
             type;
     } m_propIDs {};
 };
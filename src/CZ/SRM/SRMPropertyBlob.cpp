@@ -5,6 +5,14 @@
 using namespace CZ;
 
 std::shared_ptr<SRMPropertyBlob> SRMPropertyBlob::Make(SRMDevice *device, const void *data, size_t size) noexcept
+{
+    if (!device)
+        return {};
+
+    return device->m_blobCache.get(data, size);
+}
+
+std::shared_ptr<SRMPropertyBlob> SRMPropertyBlob::MakeUncached(SRMDevice *device, const void *data, size_t size) noexcept
 {
     if (!device)
         return {};
@@ -16,6 +24,17 @@ std::shared_ptr<SRMPropertyBlob> SRMPropertyBlob::Make(SRMDevice *device, const
     return std::shared_ptr<SRMPropertyBlob>(new SRMPropertyBlob(device, id));
 }
 
+bool SRMPropertyBlob::update(const void *data, size_t size) noexcept
+{
+    UInt32 id;
+    if (drmModeCreatePropertyBlob(device()->fd(), data, size, &id) != 0)
+        return false;
+
+    drmModeDestroyPropertyBlob(device()->fd(), m_id);
+    m_id = id;
+    return true;
+}
+
 SRMPropertyBlob::~SRMPropertyBlob() noexcept
 {
     drmModeDestroyPropertyBlob(device()->fd(), id());
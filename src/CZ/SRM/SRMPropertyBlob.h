@@ -7,8 +7,16 @@
 class CZ::SRMPropertyBlob final : public SRMObject
 {
 public:
+    // Returns a blob shared with other users of the same contents (SRMBlobCache)
     static std::shared_ptr<SRMPropertyBlob> Make(SRMDevice *device, const void *data, size_t size) noexcept;
+
+    // Creates a blob that is not shared
+    static std::shared_ptr<SRMPropertyBlob> MakeUncached(SRMDevice *device, const void *data, size_t size) noexcept;
     ~SRMPropertyBlob() noexcept;
+
+    // Replaces the contents, the kernel keeps the previous blob alive while in use.
+    // Must not be called on cached blobs other than by SRMBlobCache.
+    bool update(const void *data, size_t size) noexcept;
     UInt32 id() const noexcept { return m_id; };
     SRMDevice *device() const noexcept { return m_device; }
 private:
@@ -9,6 +9,9 @@
 #include <CZ/SRM/SRMEncoder.h>
 #include <CZ/SRM/SRMCore.h>
 #include <CZ/SRM/SRMAtomicRequest.h>
+#include <CZ/SRM/SRMCommitGroup.h>
+#include <CZ/SRM/SRMAllocCounter.h>
+#include <CZ/SRM/SRMOverlayLayer.h>
 
 #include <CZ/Ream/RImage.h>
 #include <CZ/Ream/RSurface.h>
@@ -22,12 +25,87 @@
 
 #include <CZ/Ream/GL/RGLMakeCurrent.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <future>
 #include <drm_fourcc.h>
-#include <sys/poll.h>
 
 using namespace CZ;
 
+// Max FB_DAMAGE_CLIPS rects, more fragmented regions are merged
+static constexpr size_t MaxDamageRects { 16 };
+
+// Above this count the bounding box is used directly
+static constexpr size_t MaxMergeableDamageRects { 64 };
+
+// Opaque variant of formats with alpha, the plane ignores the channel
+static RFormat AlphaSubstitute(RFormat format) noexcept
+{
+    switch (format)
+    {
+    case DRM_FORMAT_ARGB8888: return DRM_FORMAT_XRGB8888;
+    case DRM_FORMAT_ABGR8888: return DRM_FORMAT_XBGR8888;
+    case DRM_FORMAT_RGBA8888: return DRM_FORMAT_RGBX8888;
+    case DRM_FORMAT_BGRA8888: return DRM_FORMAT_BGRX8888;
+    case DRM_FORMAT_ARGB2101010: return DRM_FORMAT_XRGB2101010;
+    case DRM_FORMAT_ABGR2101010: return DRM_FORMAT_XBGR2101010;
+    case DRM_FORMAT_ARGB16161616F: return DRM_FORMAT_XRGB16161616F;
+    case DRM_FORMAT_ABGR16161616F: return DRM_FORMAT_XBGR16161616F;
+    default: return format;
+    }
+}
+
+// Whether two modes drive the display identically, names and type flags are ignored
+static bool SameTimings(const drmModeModeInfo &a, const drmModeModeInfo &b) noexcept
+{
+    return a.clock == b.clock &&
+           a.hdisplay == b.hdisplay && a.hsync_start == b.hsync_start && a.hsync_end == b.hsync_end && a.htotal == b.htotal && a.hskew == b.hskew &&
+           a.vdisplay == b.vdisplay && a.vsync_start == b.vsync_start && a.vsync_end == b.vsync_end && a.vtotal == b.vtotal && a.vscan == b.vscan &&
+           a.flags == b.flags;
+}
+
+// Time before the vblank at which cursor-only updates are committed (ns)
+static constexpr Int64 CursorLatchMargin { 1500000 };
+
+static Int64 RectArea(const drm_mode_rect &r) noexcept
+{
+    return Int64(r.x2 - r.x1) * Int64(r.y2 - r.y1);
+}
+
+static drm_mode_rect RectUnion(const drm_mode_rect &a, const drm_mode_rect &b) noexcept
+{
+    return { std::min(a.x1, b.x1), std::min(a.y1, b.y1), std::max(a.x2, b.x2), std::max(a.y2, b.y2) };
+}
+
+// Greedily merges the pair that adds the least area until rects.size() <= max
+static void MergeDamageRects(std::vector<drm_mode_rect> &rects, size_t max) noexcept
+{
+    while (rects.size() > max)
+    {
+        size_t bestA { 0 }, bestB { 1 };
+        Int64 bestCost { INT64_MAX };
+
+        for (size_t a = 0; a < rects.size(); a++)
+        {
+            for (size_t b = a + 1; b < rects.size(); b++)
+            {
+                const Int64 cost { RectArea(RectUnion(rects[a], rects[b])) - RectArea(rects[a]) - RectArea(rects[b]) };
+
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+        }
+
+        rects[bestA] = RectUnion(rects[bestA], rects[bestB]);
+        rects[bestB] = rects.back();
+        rects.pop_back();
+    }
+}
+
 std::unique_ptr<SRMRenderer> SRMRenderer::Make(SRMConnector *conn, const SRMConnectorInterface *iface, void *ifaceData) noexcept
 {
     if (!iface || !iface->initialized || !iface->uninitialized || !iface->presented || !iface->discarded || !iface->paint || !iface->resized)
@@ -92,6 +170,8 @@ SRMRenderer::~SRMRenderer() noexcept
 
     if (cursorPlane)
         cursorPlane->m_currentConnector = nullptr;
+
+    releaseOverlayPlanes(true);
 }
 
 void SRMRenderer::initContentType() noexcept
@@ -104,6 +184,24 @@ void SRMRenderer::initGamma() noexcept
     conn->setGammaLUT(nullptr);
 }
 
+void SRMRenderer::initVRR() noexcept
+{
+    if (!crtc->m_propIDs.VRR_ENABLED)
+    {
+        if (conn->m_vrr)
+            log(CZWarning, CZLN, "VRR unsupported by the CRTC");
+
+        conn->m_vrr = false;
+        return;
+    }
+
+    // The previous DRM master may have left it enabled
+    if (device()->clientCaps().Atomic)
+        atomicChanges.add(CHVRR);
+    else
+        drmModeObjectSetProperty(device()->fd(), crtc->id(), DRM_MODE_OBJECT_CRTC, crtc->m_propIDs.VRR_ENABLED, conn->m_vrr);
+}
+
 void SRMRenderer::initCursor() noexcept
 {
     if (device()->core()->m_disableCursor)
@@ -123,13 +221,28 @@ void SRMRenderer::initCursor() noexcept
     if (atomic)
         consts.caps[device()->reamDevice()].add(RImageCap_DRMFb);
 
+    // Largest size the plane recommends, otherwise the max reported by the driver
+    cursorBufferSize = SkISize::Make(device()->caps().CursorWidth, device()->caps().CursorHeight);
+
+    if (atomic && !cursorPlane->sizeHints().empty())
+    {
+        cursorBufferSize = cursorPlane->sizeHints().front();
+
+        for (const auto &hint : cursorPlane->sizeHints())
+            if (hint.area() > cursorBufferSize.area())
+                cursorBufferSize = hint;
+    }
+
     for (size_t i = 0; i < 2; i++)
     {
-        cursor[i].bo = RGBMBo::MakeCursor({ 64, 64 }, DRM_FORMAT_ARGB8888, device()->reamDevice());
+        cursor[i].bo = RGBMBo::MakeCursor(cursorBufferSize, DRM_FORMAT_ARGB8888, device()->reamDevice());
 
         if (!cursor[i].bo)
             goto fail;
 
+        cursor[i].planeSize = cursorBufferSize;
+        cursor[i].hotspot = {};
+
         if (atomic)
         {
             cursor[i].fb = RDRMFramebuffer::MakeFromGBMBo(cursor[i].bo);
@@ -139,7 +252,12 @@ void SRMRenderer::initCursor() noexcept
         }
     }
 
+    cursorStaging.resize(gbm_bo_get_stride(cursor[0].bo->bo()) * cursorBufferSize.height());
     cursorAPI = atomic ? CursorAPI::Atomic : CursorAPI::Legacy;
+
+    // The previous DRM master may have left the plane enabled, its state is part of the modeset commit
+    if (atomic)
+        atomicChanges.add(CHCursorVisibility);
     return;
 
 fail:
@@ -148,9 +266,21 @@ fail:
         cursor[i].bo.reset();
         cursor[i].fb.reset();
     }
+    cursorBufferSize = {};
     cursorAPI = CursorAPI::None;
 }
 
+SkISize SRMRenderer::cursorPlaneSize(SkISize imageSize) const noexcept
+{
+    // Hints are in order of preference, the first one that fits the image wins
+    if (cursorAPI == CursorAPI::Atomic)
+        for (const auto &hint : cursorPlane->sizeHints())
+            if (hint.width() >= imageSize.width() && hint.height() >= imageSize.height())
+                return hint;
+
+    return cursorBufferSize;
+}
+
 bool SRMRenderer::startRenderThread() noexcept
 {
     std::promise<bool> initPromise;
@@ -159,14 +289,11 @@ bool SRMRenderer::startRenderThread() noexcept
     std::thread([this](std::promise<bool> initPromise)
     {
         threadId = std::this_thread::get_id();
-        drmEventCtx.version = DRM_EVENT_CONTEXT_VERSION,
-        drmEventCtx.vblank_handler = NULL,
-        drmEventCtx.page_flip_handler = &PageFlipHandler,
-        drmEventCtx.page_flip_handler2 = NULL;
-        drmEventCtx.sequence_handler = NULL;
+        device()->m_reactor->attach(crtc->id(), &flipQueue, &repaintSemaphore);
 
         if (!init())
         {
+            device()->m_reactor->detach(crtc->id());
             log(CZError, CZLN, "Failed to initialize renderer");
             initPromise.set_value(false);
             return;
@@ -194,11 +321,21 @@ bool SRMRenderer::startRenderThread() noexcept
             // E.g. if physically unplugged
             if (isDead)
             {
+                if (commitGroup)
+                {
+                    commitGroup->leave(this);
+                    commitGroup.reset();
+                }
+
                 pendingRepaint = 0;
                 atomicChanges = 0;
                 continue;
             }
 
+            // Any activity restores the refresh rate of the current mode
+            if (idleMode && !pendingMode)
+                leaveIdleMode();
+
             // Set mode
             if (pendingMode)
             {
@@ -227,20 +364,62 @@ bool SRMRenderer::startRenderThread() noexcept
                 }
             }
 
+            updateBufferCount();
+
+            // Keep presenting the current buffer
+            if (conn->m_currentBufferLocked)
+                pendingRepaint = false;
+
             // paintGL...
             if (pendingRepaint)
             {
+                waitForPaintDeadline();
                 pendingRepaint = false;
                 rendering = true;
                 rendRender();
                 rendering = false;
-                flipPage();
-                swapchain.advanceAge();
+
+                if (pendingScanoutFb)
+                {
+                    flipPageCustom();
+
+                    // The swapchain images missed the custom frames, the next one gets a full repaint
+                    scanoutActive = true;
+                }
+                else
+                {
+                    if (scanoutActive)
+                    {
+                        scanoutActive = false;
+                        swapchain.resetAge();
+                    }
+
+                    flipPage();
+                    swapchain.pushDamage(conn->damage);
+                    swapchain.advanceAge();
+                }
+
+                // Held until the next flip completes
+                m_userScanoutBuffers[1] = std::move(m_userScanoutBuffers[0]);
+                m_userScanoutBuffers[0] = std::move(pendingScanoutImage);
+                pendingScanoutFb.reset();
                 continue;
             }
             // Only updates the cursor, gamma, etc
-            else if (atomicChanges && currentFb)
+            else if ((atomicChanges || cursorLatchDirty) && currentFb)
             {
+                // Position only, sampled as late as possible and committed at most once per vblank
+                if (atomicChanges == 0)
+                {
+                    if (!waitForCursorDeadline())
+                        continue; // Latched by the repaint commit
+
+                    const std::lock_guard<std::recursive_mutex> lock { propsMutex };
+
+                    if (!latchCursor() || cursorAPI != CursorAPI::Atomic)
+                        continue;
+                }
+
                 commit(currentFb, false);
             }
 
@@ -293,13 +472,22 @@ bool SRMRenderer::startRenderThread() noexcept
 
 bool SRMRenderer::init() noexcept
 {
+    if (device()->clientCaps().Atomic)
+        frameReq = SRMAtomicRequest::Make(device());
+
     initContentType();
     initGamma();
     initCursor();
+    initVRR();
 
     if (!applyCrtcMode())
         return false;
 
+    commitGroup = conn->m_commitGroup;
+
+    if (commitGroup)
+        commitGroup->join(this);
+
     iface->initialized(conn, ifaceData);
     return true;
 }
@@ -309,6 +497,12 @@ void SRMRenderer::unit() noexcept
     iface->uninitialized(conn, ifaceData);
     conn->setCursor(nullptr);
 
+    if (commitGroup)
+    {
+        commitGroup->leave(this);
+        commitGroup.reset();
+    }
+
     waitPendingPageFlip(1);
 
     if (device()->clientCaps().Atomic)
@@ -323,6 +517,16 @@ void SRMRenderer::unit() noexcept
         drmModeSetCrtc(device()->fd(), crtc->id(), 0, 0, 0, NULL, 0, NULL);
     }
 
+    overlays.clear();
+    releaseOverlayPlanes(true);
+
+    for (auto &fbs : overlayFbs)
+        fbs.clear();
+
+    // The CRTC is disabled, all the buffers can be reused by the next initialization
+    recycleSwapchain(swapchain, strategy, true);
+
+    device()->m_reactor->detach(crtc->id());
     unitPromise.value().set_value(true);
 }
 
@@ -331,23 +535,49 @@ bool SRMRenderer::applyCrtcMode() noexcept
     Int32 ret;
 
     waitPendingPageFlip(-1);
+    lastVblank = {};
+    templatesValid = false;
+    idleMode.reset();
+    idleModeUnavailable = false;
+    crtc->m_testCache.clear();
+
+    // If the CRTC is active with the same resolution (e.g. left by the bootloader, a previous DRM master
+    // or only the refresh rate changes) the mode may be switched without a modeset
+    bool sameTimings { false };
+    const UInt32 committedBlobId { device()->clientCaps().Atomic ? committedModeBlob(&sameTimings) : 0 };
+    const bool keepSwapchain { committedBlobId && swapchainSize == conn->currentMode()->size() };
+
+    if (!keepSwapchain)
+    {
+        // The geometry of the layers belongs to the previous mode, the client assigns them again
+        if (!overlayPlanes.empty())
+        {
+            overlays.clear();
+            atomicChanges.add(CHOverlays);
+        }
 
-    if (!initSwapchain())
-        return false;
+        if (!initSwapchain())
+            return false;
+    }
 
     if (device()->clientCaps().Atomic)
     {
-        // DPMS OFF
+        // Mode, planes, gamma, content type, VRR and cursor in a single modeset
         auto req { SRMAtomicRequest::Make(device()) };
-        req->addProperty(crtc->id(), crtc->m_propIDs.ACTIVE, 0);
-        req->commit(DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr, true);
-
-        // SET MODE AND OTHER PROPS
-        req = SRMAtomicRequest::Make(device());
-        auto modeBlob = SRMPropertyBlob::Make(device(), &conn->currentMode()->info(), sizeof(drmModeModeInfo));
-        req->attachPropertyBlob(modeBlob);
-        req->addProperty(crtc->id(), crtc->m_propIDs.MODE_ID, modeBlob->id());
-        req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.FB_ID, swapchain.fb()->id());
+
+        // With the same timings the committed blob is reused, so only the planes change
+        std::shared_ptr<SRMPropertyBlob> modeBlob;
+
+        if (!sameTimings)
+        {
+            modeBlob = SRMPropertyBlob::Make(device(), &conn->currentMode()->info(), sizeof(drmModeModeInfo));
+            req->attachPropertyBlob(modeBlob);
+        }
+
+        req->addProperty(crtc->id(), crtc->m_propIDs.ACTIVE, 1);
+        req->addProperty(crtc->id(), crtc->m_propIDs.MODE_ID, sameTimings ? committedBlobId : modeBlob->id());
+        // A kept swapchain continues presenting the current frame
+        req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.FB_ID, (keepSwapchain && currentFb ? currentFb : swapchain.fb())->id());
         req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.CRTC_ID, crtc->id());
         req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.CRTC_X, 0);
         req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.CRTC_Y, 0);
@@ -363,12 +593,55 @@ bool SRMRenderer::applyCrtcMode() noexcept
 
         auto prevCursorIndex { cursorI };
         atomicReqAppendChanges(req, nullptr);
-        ret = req->commit(DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr, true);
 
-        // DPMS ON
-        req = SRMAtomicRequest::Make(device());
-        req->addProperty(crtc->id(), crtc->m_propIDs.ACTIVE, 1);
-        req->commit(DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr, true);
+        if (committedBlobId)
+        {
+            // Only drivers supporting seamless timing changes accept new timings, rejections only cost the TEST_ONLY ioctl
+            ret = req->commit(0, nullptr, true);
+
+            if (ret == 0)
+                log(CZDebug, CZLN, "Mode {} applied without a modeset", *conn->currentMode());
+            else
+            {
+                // E.g. the connector was routed to another CRTC, do a full modeset instead
+                log(CZTrace, CZLN, "Seamless mode switch failed ({}), falling back to a modeset", strerror(-ret));
+
+                if (sameTimings)
+                {
+                    modeBlob = SRMPropertyBlob::Make(device(), &conn->currentMode()->info(), sizeof(drmModeModeInfo));
+                    req->attachPropertyBlob(modeBlob);
+                    *req->value(crtc->id(), crtc->m_propIDs.MODE_ID) = modeBlob->id();
+                }
+            }
+        }
+
+        if (!committedBlobId || ret)
+            ret = req->commit(DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr, true);
+
+        if (ret && ret != -EBUSY)
+        {
+            // Some drivers reject switching modes on an active CRTC, retry through DPMS OFF
+            log(CZTrace, CZLN, "Single commit modeset failed ({}), retrying with the CRTC disabled", strerror(-ret));
+            auto offReq { SRMAtomicRequest::Make(device()) };
+            offReq->addProperty(crtc->id(), crtc->m_propIDs.ACTIVE, 0);
+
+            if (offReq->commit(DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr, true) == 0)
+            {
+                // ACTIVE is now part of the diff
+                ret = req->commit(DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr, true);
+
+                // Keep the previous mode on screen, the caller rolls back to it
+                if (ret)
+                {
+                    offReq->reset();
+                    offReq->addProperty(crtc->id(), crtc->m_propIDs.ACTIVE, 1);
+                    offReq->commit(DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr, true);
+                }
+            }
+        }
+
+        if (ret == 0)
+            releaseOverlayPlanes(false);
 
         if (ret)
         {
@@ -385,8 +658,7 @@ bool SRMRenderer::applyCrtcMode() noexcept
     }
     else
     {
-        drmModeConnectorSetProperty(device()->fd(), conn->m_id, conn->m_propIDs.DPMS, DRM_MODE_DPMS_OFF);
-
+        // drmModeSetCrtc() already disables the CRTC if the driver needs it
         ret = drmModeSetCrtc(device()->fd(),
                              crtc->id(),
                              swapchain.fb()->id(),
@@ -396,21 +668,162 @@ bool SRMRenderer::applyCrtcMode() noexcept
                              1,
                              &conn->currentMode()->m_info);
 
-        drmModeConnectorSetProperty(device()->fd(), conn->m_id, conn->m_propIDs.DPMS, DRM_MODE_DPMS_ON);
-
         if (ret)
         {
             logLegacy(CZError, CZLN, "Failed to set CRTC mode. DRM Error: {}", strerror(-ret));
             return false;
         }
+
+        // The previous DRM master may have left it off
+        drmModeConnectorSetProperty(device()->fd(), conn->m_id, conn->m_propIDs.DPMS, DRM_MODE_DPMS_ON);
     }
 
     return true;
 }
 
+UInt32 SRMRenderer::committedModeBlob(bool *sameTimings) noexcept
+{
+    *sameTimings = false;
+    UInt64 active { 0 }, blobId { 0 };
+
+    if (!device()->m_kmsState.get(crtc->id(), crtc->m_propIDs.ACTIVE, &active) || !active ||
+        !device()->m_kmsState.get(crtc->id(), crtc->m_propIDs.MODE_ID, &blobId) || !blobId)
+        return 0;
+
+    drmModePropertyBlobPtr blob { drmModeGetPropertyBlob(device()->fd(), blobId) };
+
+    if (!blob)
+        return 0;
+
+    bool sameSize { false };
+
+    if (blob->length == sizeof(drmModeModeInfo))
+    {
+        const auto &info { *static_cast<const drmModeModeInfo*>(blob->data) };
+        sameSize = info.hdisplay == conn->currentMode()->info().hdisplay && info.vdisplay == conn->currentMode()->info().vdisplay;
+        *sameTimings = SameTimings(info, conn->currentMode()->info());
+    }
+
+    drmModeFreePropertyBlob(blob);
+    return sameSize ? blobId : 0;
+}
+
+int SRMRenderer::commitSeamlessMode(const SRMConnectorMode *mode) noexcept
+{
+    const std::lock_guard<std::recursive_mutex> lock { propsMutex };
+    auto blob { SRMPropertyBlob::Make(device(), &mode->info(), sizeof(drmModeModeInfo)) };
+
+    if (!blob)
+        return -ENOMEM;
+
+    // Without ALLOW_MODESET, rejected by drivers that can't change the timings seamlessly
+    auto req { SRMAtomicRequest::Make(device()) };
+    req->attachPropertyBlob(blob);
+    req->addProperty(crtc->id(), crtc->m_propIDs.MODE_ID, blob->id());
+    const int ret { req->commit(0, nullptr, true) };
+
+    if (ret == 0)
+        lastVblank = {};
+
+    return ret;
+}
+
+const SRMConnectorMode *SRMRenderer::scanoutMode() const noexcept
+{
+    if (idleMode)
+        return idleMode;
+
+    return conn->currentMode();
+}
+
+bool SRMRenderer::canEnterIdleMode() const noexcept
+{
+    return conn->m_idleRefreshRate &&
+           !idleMode &&
+           !idleModeUnavailable &&
+           currentFb &&
+           currentVSync &&
+           conn->type() == DRM_MODE_CONNECTOR_eDP &&
+           device()->clientCaps().Atomic &&
+           !vrrActive();
+}
+
+void SRMRenderer::enterIdleMode() noexcept
+{
+    // Same resolution, lowest refresh rate first
+    std::vector<SRMConnectorMode*> candidates;
+
+    for (auto *mode : conn->modes())
+        if (mode->size() == conn->currentMode()->size() && mode->refreshRate() < conn->currentMode()->refreshRate())
+            candidates.emplace_back(mode);
+
+    std::sort(candidates.begin(), candidates.end(), [](auto *a, auto *b){ return a->refreshRate() < b->refreshRate(); });
+
+    for (auto *mode : candidates)
+    {
+        if (commitSeamlessMode(mode) == 0)
+        {
+            idleMode = mode;
+            log(CZTrace, CZLN, "Idle, refresh rate lowered to {}", *mode);
+            return;
+        }
+    }
+
+    // Not retried until the mode changes
+    idleModeUnavailable = true;
+    log(CZTrace, CZLN, "Idle, no seamless refresh rate available for {}", *conn->currentMode());
+}
+
+void SRMRenderer::leaveIdleMode() noexcept
+{
+    const int ret { commitSeamlessMode(conn->currentMode()) };
+
+    if (ret)
+        log(CZError, CZLN, "Failed to restore mode {} after idle: {}", *conn->currentMode(), strerror(-ret));
+
+    idleMode.reset();
+}
+
 bool SRMRenderer::initSwapchain() noexcept
 {
+    const auto n { targetBufferCount() };
+    rejectedBufferCount = 0;
+    allocCheckWarmup = 120;
+
+    swapchainSize = conn->currentMode()->size();
+
+    if (initSwapchain(n))
+        return true;
+
+    if (n > 2)
+    {
+        log(CZWarning, CZLN, "Failed to create swapchain with {} buffers, falling back to double buffering", n);
+        rejectedBufferCount = n;
+
+        if (initSwapchain(2))
+            return true;
+    }
+
+    log(CZError, CZLN, "Failed to create swapchain");
+    swapchainSize = {};
+    return false;
+}
+
+bool SRMRenderer::initSwapchain(UInt32 n) noexcept
+{
+    if (!swapchain.fbs.empty())
+        recycleSwapchain(swapchain, strategy, false);
+
+    {
+        // The transfer may be replaced or not used by the new swapchain
+        const std::lock_guard<std::mutex> lock { transferStatsMutex };
+        transferStats = {};
+    }
+
     swapchain = {};
+    swapchain.n = n;
+
+    if (initSwapchainPooled()) return true;
 
     strategy = Self;
     if (initSwapchainSelf()) return true;
@@ -421,11 +834,85 @@ bool SRMRenderer::initSwapchain() noexcept
     strategy = Dumb;
     if (initSwapchainDumb()) return true;
 
-    log(CZError, CZLN, "Failed to create swapchain");
-
     return false;
 }
 
+void SRMRenderer::recycleSwapchain(Swapchain &sc, Strategy scStrategy, bool includeCurrent) noexcept
+{
+    for (size_t i = 0; i < sc.fbs.size(); i++)
+    {
+        // Still being scanned out
+        if (!includeCurrent && sc.fbs[i] == currentFb)
+            continue;
+
+        SRMSwapchainPool::Buffer buffer;
+        buffer.fb = sc.fbs[i];
+        if (i < sc.images.size()) buffer.image = sc.images[i];
+        if (i < sc.surfaces.size()) buffer.surface = sc.surfaces[i];
+        if (i < sc.primeImages.size()) buffer.primeImage = sc.primeImages[i];
+        if (i < sc.primeSurfaces.size()) buffer.primeSurface = sc.primeSurfaces[i];
+        if (i < sc.dumbBuffers.size()) buffer.dumbBuffer = sc.dumbBuffers[i];
+
+        SRMSwapchainPool::Key key {};
+        key.strategy = scStrategy;
+        key.zeroCopy = sc.zeroCopy;
+
+        if (buffer.dumbBuffer)
+        {
+            key.size = buffer.image->size();
+            key.format = buffer.dumbBuffer->formatInfo().format;
+            key.modifier = DRM_FORMAT_MOD_LINEAR;
+        }
+        else
+        {
+            const auto &scanout { buffer.primeImage ? buffer.primeImage : buffer.image };
+            key.size = scanout->size();
+            key.format = scanout->formatInfo().format;
+            key.modifier = scanout->modifier();
+        }
+
+        device()->m_swapchainPool.put(key, std::move(buffer));
+    }
+
+    sc.fbs.clear();
+}
+
+bool SRMRenderer::initSwapchainPooled() noexcept
+{
+    std::vector<SRMSwapchainPool::Buffer> buffers;
+    SRMSwapchainPool::Key key;
+
+    if (!device()->m_swapchainPool.take(conn->currentMode()->size(), swapchain.n, primaryPlane, &buffers, &key))
+        return false;
+
+    strategy = static_cast<Strategy>(key.strategy);
+    swapchain.zeroCopy = key.zeroCopy;
+
+    // Buffers of the same key come from the same strategy and fill the same members
+    for (auto &buffer : buffers)
+    {
+        swapchain.fbs.emplace_back(std::move(buffer.fb));
+        if (buffer.image) swapchain.images.emplace_back(std::move(buffer.image));
+        if (buffer.surface) swapchain.surfaces.emplace_back(std::move(buffer.surface));
+        if (buffer.primeImage) swapchain.primeImages.emplace_back(std::move(buffer.primeImage));
+        if (buffer.primeSurface) swapchain.primeSurfaces.emplace_back(std::move(buffer.primeSurface));
+        if (buffer.dumbBuffer) swapchain.dumbBuffers.emplace_back(std::move(buffer.dumbBuffer));
+    }
+
+    if (strategy == Dumb)
+    {
+        if (swapchain.zeroCopy)
+        {
+            transfer.reset();
+            staging = {};
+        }
+        else
+            initDumbTransfer();
+    }
+
+    return true;
+}
+
 bool SRMRenderer::initSwapchainSelf() noexcept
 {
     auto ream { RCore::Get() };
@@ -639,6 +1126,9 @@ bool SRMRenderer::initSwapchainDumb() noexcept
         if (!preferred.contains(fmt.format()))
             formats.emplace_back(&fmt);
 
+    if (ream->asRS() && device()->core()->m_dumbZeroCopy && initSwapchainDumbZeroCopy(formats))
+        return true;
+
     swapchain.fbs.resize(swapchain.n);
     swapchain.dumbBuffers.resize(swapchain.n);
     swapchain.images.resize(swapchain.n);
@@ -700,51 +1190,270 @@ bool SRMRenderer::initSwapchainDumb() noexcept
     if (!ok)
         return false;
 
+    initDumbTransfer();
     return ok;
 }
 
-bool SRMRenderer::flipPage() noexcept
+void SRMRenderer::initDumbTransfer() noexcept
 {
-    switch (strategy)
-    {
-    case Self:
-        flipPageSelf();
-        break;
-    case Prime:
-        flipPagePrime();
-        break;
-    case Dumb:
-        flipPageDumb();
-        break;
-    }
+    SRMPixelTransfer::Kernel kernel;
 
-    commit(swapchain.fb(), true);
-    return true;
-}
+    if (SRMPixelTransfer::GetKernel(swapchain.images[0]->formatInfo().format, swapchain.dumbBuffers[0]->formatInfo().format, &kernel))
+    {
+        if (!transfer)
+            transfer = SRMPixelTransfer::Make(device()->core()->m_transferThreads);
 
-bool SRMRenderer::flipPageSelf() noexcept
-{
-    if (device()->clientCaps().Atomic && primaryPlane->m_propIDs.IN_FENCE_FD)
+        stagingStride = swapchain.images[0]->size().width() * 4;
+        staging.resize(stagingStride * swapchain.images[0]->size().height());
+    }
+    else
     {
-        if (swapchain.image()->writeSync())
-        {
-            swapchain.image()->writeSync()->gpuWait(device()->reamDevice());
-            inFence.reset(swapchain.image()->writeSync()->fd().release());
-        }
+        transfer.reset();
+        staging = {};
     }
+}
 
-    if (device()->reamDevice()->drmDriver() == RDriver::nvidia && inFence.get() < 0)
-        device()->reamDevice()->wait();
+UInt32 SRMRenderer::targetBufferCount() const noexcept
+{
+    if (!conn->m_adaptiveBuffering)
+        return conn->m_bufferCount;
 
-    return true;
+    return adaptiveBoost ? std::max(3U, conn->m_bufferCount.load()) : 2;
 }
 
-bool SRMRenderer::flipPagePrime() noexcept
+void SRMRenderer::updateBufferCount() noexcept
 {
-    auto srcImage { swapchain.image() };
-    auto ream { RCore::Get() };
+    const auto target { targetBufferCount() };
 
-    const bool gpuSync { srcImage->writeSync() && device()->caps().PrimeImport && ream->mainDevice()->caps().SyncExport };
+    if (target == swapchain.n || target == rejectedBufferCount)
+        return;
+
+    // currentFb keeps the buffer being scanned out alive
+    waitPendingPageFlip(-1);
+
+    const auto prevStrategy { strategy };
+    auto prevSwapchain { std::move(swapchain) };
+
+    if (initSwapchain(target))
+    {
+        log(CZTrace, "Buffer count changed {} -> {} ({})", prevSwapchain.n, swapchain.n, StrategyString(strategy));
+        rejectedBufferCount = 0;
+        recycleSwapchain(prevSwapchain, prevStrategy, false);
+        iface->resized(conn, ifaceData);
+        return;
+    }
+
+    log(CZWarning, CZLN, "Failed to reallocate swapchain with {} buffers, keeping {}", target, prevSwapchain.n);
+    rejectedBufferCount = target;
+    swapchain = std::move(prevSwapchain);
+    strategy = prevStrategy;
+}
+
+void SRMRenderer::updateAdaptiveBuffering() noexcept
+{
+    if (!conn->m_adaptiveBuffering || adaptiveBoost || !currentVSync)
+        return;
+
+    const Int64 period { static_cast<Int64>(scanoutMode()->period()) };
+
+    if (period == 0)
+        return;
+
+    // With double buffering paint + copy must fit within a refresh period, otherwise the next vblank is missed
+    if (framePaintCost < period)
+    {
+        missedFrames = 0;
+        return;
+    }
+
+    if (++missedFrames < 3)
+        return;
+
+    missedFrames = 0;
+    adaptiveBoost = true;
+    log(CZTrace, "Frames keep missing vblank, switching to {} buffers", targetBufferCount());
+}
+
+bool SRMRenderer::initSwapchainDumbZeroCopy(const std::vector<const RDRMFormat*> &formats) noexcept
+{
+    // The raster renderer paints directly into linear buffers allocated and scanned out by the display device
+    RImageConstraints consts {};
+    consts.allocator = device()->reamDevice();
+    consts.caps[device()->reamDevice()] = RImageCap_Dst | RImageCap_DRMFb;
+
+    swapchain.fbs.resize(swapchain.n);
+    swapchain.images.resize(swapchain.n);
+
+    for (const auto *fmt : formats)
+    {
+        bool ok { true };
+
+        for (size_t i = 0; i < swapchain.n; i++)
+        {
+            swapchain.images[i] = RImage::Make(conn->currentMode()->size(), { fmt->format(), { DRM_FORMAT_MOD_LINEAR } }, &consts);
+
+            if (!swapchain.images[i])
+            {
+                log(CZTrace, CZLN, "Failed to create zero-copy swapchain RImage {}/{}", i + 1, swapchain.n);
+                ok = false;
+                break;
+            }
+
+            swapchain.fbs[i] = swapchain.images[i]->drmFb(device()->reamDevice());
+
+            if (!swapchain.fbs[i])
+            {
+                log(CZTrace, CZLN, "Failed to get zero-copy swapchain RDRMFramebuffer {}/{}", i + 1, swapchain.n);
+                ok = false;
+                break;
+            }
+        }
+
+        if (ok)
+        {
+            swapchain.zeroCopy = true;
+            transfer.reset();
+            staging = {};
+            return true;
+        }
+    }
+
+    swapchain.fbs.clear();
+    swapchain.images.clear();
+    return false;
+}
+
+bool SRMRenderer::flipPage() noexcept
+{
+    switch (strategy)
+    {
+    case Self:
+        flipPageSelf();
+        break;
+    case Prime:
+        flipPagePrime();
+        break;
+    case Dumb:
+        flipPageDumb();
+        break;
+    }
+
+    commit(swapchain.fb(), true);
+    return true;
+}
+
+bool SRMRenderer::setScanoutImage(std::shared_ptr<RImage> image) noexcept
+{
+    pendingScanoutImage.reset();
+    pendingScanoutFb.reset();
+
+    if (!image)
+        return false;
+
+    const auto &mode { conn->currentMode()->info() };
+
+    if (image->size().width() != mode.hdisplay || image->size().height() != mode.vdisplay)
+    {
+        log(CZError, CZLN, "Failed to set custom scanout image. Its size must match the current mode");
+        return false;
+    }
+
+    RFormat format { image->formatInfo().format };
+    const RModifier modifier { image->modifier() };
+
+    // Planes ignore the alpha channel of the primary layer, scan it out as the opaque variant if needed
+    if (!primaryPlane->formats().has(format, modifier))
+    {
+        const RFormat substitute { AlphaSubstitute(format) };
+
+        if (substitute == format || !primaryPlane->formats().has(substitute, modifier))
+        {
+            log(CZError, CZLN, "Failed to set custom scanout image. Unsupported format/modifier: {} - {}",
+                RDRMFormat::FormatName(format), RDRMFormat::ModifierName(modifier));
+            return false;
+        }
+
+        format = substitute;
+    }
+
+    SRMFramebufferCache::Layout layout;
+    auto fb { device()->m_fbCache.get(image, format, &layout) };
+
+    if (!fb)
+    {
+        log(CZError, CZLN, "Failed to set custom scanout image. Could not create a DRM framebuffer");
+        return false;
+    }
+
+    // Stride, offsets or placement may still be rejected by the hardware
+    if (device()->clientCaps().Atomic)
+    {
+        auto req { SRMAtomicRequest::Make(device()) };
+        req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.FB_ID, fb->id());
+
+        SRMTestCache::Key key;
+        key.add('S')
+           .add(primaryPlane->id())
+           .add(format)
+           .add(modifier)
+           .add(static_cast<UInt64>(image->size().width()))
+           .add(static_cast<UInt64>(image->size().height()))
+           .add(layout.planeCount);
+
+        for (UInt32 i = 0; i < layout.planeCount; i++)
+            key.add(layout.pitches[i]).add(layout.offsets[i]);
+
+        if (const int ret { testCommit(req, key) })
+        {
+            log(CZError, CZLN, "Failed to set custom scanout image. Rejected by the primary plane: {}", strerror(-ret));
+            return false;
+        }
+    }
+
+    pendingScanoutImage = image;
+    pendingScanoutFb = fb;
+    return true;
+}
+
+void SRMRenderer::flipPageCustom() noexcept
+{
+    auto sync { pendingScanoutImage->writeSync() };
+
+    if (sync)
+    {
+        if (device()->clientCaps().Atomic && primaryPlane->m_propIDs.IN_FENCE_FD)
+            inFence.reset(sync->fd().release());
+
+        if (inFence.get() < 0)
+            pendingScanoutImage->allocator()->wait();
+    }
+
+    commit(pendingScanoutFb, true);
+}
+
+bool SRMRenderer::flipPageSelf() noexcept
+{
+    if (device()->clientCaps().Atomic && primaryPlane->m_propIDs.IN_FENCE_FD)
+    {
+        if (swapchain.image()->writeSync())
+        {
+            swapchain.image()->writeSync()->gpuWait(device()->reamDevice());
+            inFence.reset(swapchain.image()->writeSync()->fd().release());
+        }
+    }
+
+    if (device()->reamDevice()->drmDriver() == RDriver::nvidia && inFence.get() < 0)
+        device()->reamDevice()->wait();
+
+    return true;
+}
+
+bool SRMRenderer::flipPagePrime() noexcept
+{
+    auto srcImage { swapchain.image() };
+    auto ream { RCore::Get() };
+
+    const bool gpuSync { srcImage->writeSync() && device()->caps().PrimeImport && ream->mainDevice()->caps().SyncExport };
 
     if (!gpuSync)
         srcImage->allocator()->wait();
@@ -756,7 +1465,7 @@ bool SRMRenderer::flipPagePrime() noexcept
     info.image = srcImage;
     info.src = SkRect::Make(srcImage->size());
     info.dst = SkIRect::MakeSize(srcImage->size());
-    p->drawImage(info, &conn->damage);
+    p->drawImage(info, &copyRegion());
     pass.reset();
 
     auto primeImage { swapchain.primeImage() };
@@ -772,15 +1481,56 @@ bool SRMRenderer::flipPagePrime() noexcept
 
 bool SRMRenderer::flipPageDumb() noexcept
 {
+    // Already painted into the scanout buffer
+    if (swapchain.zeroCopy)
+        return true;
+
     auto dumb { swapchain.dumbBuffer() };
+    const auto &region { copyRegion() };
+    SRMPixelTransfer::Kernel kernel;
     RPixelBufferRegion info {};
+
+    // Read back into cached memory, then copy into the write-combined mapping in parallel
+    if (transfer && SRMPixelTransfer::GetKernel(swapchain.image()->formatInfo().format, dumb->formatInfo().format, &kernel))
+    {
+        timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        info.pixels = staging.data();
+        info.stride = stagingStride;
+        info.format = swapchain.image()->formatInfo().format;
+        info.region = region;
+
+        if (!swapchain.image()->readPixels(info))
+            return false;
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        transfer->stats().lastReadbackNs = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+        transfer->run(kernel, staging.data(), stagingStride, static_cast<UInt8*>(dumb->pixels()), dumb->stride(), region);
+
+        const std::lock_guard<std::mutex> lock { transferStatsMutex };
+        transferStats = transfer->stats();
+        return true;
+    }
+
     info.pixels = dumb->pixels();
     info.stride = dumb->stride();
     info.format = dumb->formatInfo().format;
-    info.region = conn->damage;
+    info.region = region;
     return swapchain.image()->readPixels(info);
 }
 
+const SkRegion &SRMRenderer::copyRegion() noexcept
+{
+    // The destination buffer holds the content of swapchain.age frames ago
+    copyDamage.setRegion(conn->damage);
+
+    if (!swapchain.damageSince(swapchain.age, copyDamage))
+        copyDamage.setRect(SkIRect::MakeSize(swapchain.image()->size()));
+
+    return copyDamage;
+}
+
 void SRMRenderer::PageFlipHandler(Int32 fd, UInt32 seq, UInt32 sec, UInt32 usec, void *data) noexcept
 {
     CZ_UNUSED(fd);
@@ -791,86 +1541,326 @@ void SRMRenderer::PageFlipHandler(Int32 fd, UInt32 seq, UInt32 sec, UInt32 usec,
         auto *rend { frame->rend };
         rend->pendingPageFlip = false;
 
-        for (auto it = rend->frameQueue.begin(); it != rend->frameQueue.end();)
+        while (rend->frameQueueSize > 0)
         {
-            if ((*it).info.paintEventId != frame->info.paintEventId)
+            Frame &front { rend->frameQueue[rend->frameQueueHead] };
+            rend->frameQueueHead = (rend->frameQueueHead + 1) % MaxQueuedFrames;
+            rend->frameQueueSize--;
+
+            if (&front != frame)
             {
-                if ((*it).info.flags != 0)
-                    rend->iface->discarded(rend->conn, (*it).info.paintEventId, frame->rend->ifaceData);
+                if (front.info.flags != 0)
+                {
+                    const SRMAllocCounter::Pause pause;
+                    rend->iface->discarded(rend->conn, front.info.paintEventId, rend->ifaceData);
+                }
 
-                it = rend->frameQueue.erase(it);
+                continue;
             }
-            else
+
+            // Cursor-only commits also keep the vblank prediction fresh
+            if (frame->vsync)
+            {
+                rend->lastVblank.tv_sec = sec;
+                rend->lastVblank.tv_nsec = usec * 1000;
+            }
+
+            if (frame->info.flags.get() != 0)
             {
-                if (frame->info.flags.get() != 0)
+                frame->info.seq = seq;
+
+                if (frame->info.flags.has(CZPresentationTime::VSync))
+                {
+                    frame->info.time.tv_sec = sec;
+                    frame->info.time.tv_nsec = usec * 1000;
+                    frame->info.period = rend->scanoutMode()->period();
+                }
+                else
                 {
-                    frame->info.seq = seq;
+                    frame->info.period = 0;
+                    clock_gettime(rend->device()->caps().TimestampMonotonic ? CLOCK_MONOTONIC : CLOCK_REALTIME, &frame->info.time);
+                }
 
-                    if (frame->info.flags.has(CZPresentationTime::VSync))
-                    {
-                        frame->info.time.tv_sec = sec;
-                        frame->info.time.tv_nsec = usec * 1000;
-                        frame->info.period = rend->conn->currentMode()->info().vrefresh == 0 ? 0 : 1000000000/rend->conn->currentMode()->info().vrefresh;
-                    }
-                    else
-                    {
-                        frame->info.period = 0;
-                        clock_gettime(rend->device()->caps().TimestampMonotonic ? CLOCK_MONOTONIC : CLOCK_REALTIME, &frame->info.time);
-                    }
+                const SRMAllocCounter::Pause pause;
+                rend->iface->presented(rend->conn, frame->info, rend->ifaceData);
+            }
+
+            break;
+        }
+    }
+}
+
+void SRMRenderer::dispatchFlipEvents() noexcept
+{
+    const UInt64 allocs { SRMAllocCounter::Count() };
+    SRMEventReactor::FlipEvent event;
+
+    while (flipQueue.pop(&event))
+    {
+        if (commitGroup && event.data == commitGroup.get())
+        {
+            event.data = groupFrame;
+            groupFrame = nullptr;
+        }
+
+        PageFlipHandler(device()->fd(), event.seq, event.sec, event.usec, event.data);
+    }
+
+    checkFrameAllocs(allocs, "dispatchFlipEvents()");
+}
+
+void SRMRenderer::waitForRepaintRequest() noexcept
+{
+    dispatchFlipEvents();
+
+    const bool needsWait {
+        (!pendingRepaint && atomicChanges == 0 && !cursorLatchDirty && !unitPromise.has_value() && !pendingMode && !missedWake) ||
+        device()->core()->isSuspended() };
+
+    missedWake = false;
+
+    if (!needsWait)
+        return;
+
+    atomicChanges.set(0);
+
+    // Repeat the current frame if the next one doesn't arrive before the panel's min refresh rate
+    while (lfcRepeats > 0 && currentFb && vrrActive() && !device()->core()->isSuspended())
+    {
+        if (repaintSemaphore.try_acquire_until(lfcNextRepeat))
+        {
+            dispatchFlipEvents();
+            return;
+        }
+
+        lfcRepeats--;
+        lfcNextRepeat += lfcStep;
+        commit(currentFb, false);
+        waitPendingPageFlip(-1);
+    }
+
+    if (adaptiveBoost && conn->m_adaptiveBuffering)
+    {
+        if (repaintSemaphore.try_acquire_for(std::chrono::seconds(1)))
+        {
+            dispatchFlipEvents();
+            return;
+        }
+
+        adaptiveBoost = false;
+        missedFrames = 0;
+        log(CZTrace, "Idle, switching back to double buffering");
+        // Reallocated in the next iteration
+    }
+
+    // Drop to a lower refresh rate if the screen stays static
+    if (canEnterIdleMode())
+    {
+        if (repaintSemaphore.try_acquire_for(std::chrono::milliseconds(conn->m_idleRefreshRateDelay)))
+        {
+            dispatchFlipEvents();
+            return;
+        }
+
+        enterIdleMode();
+    }
+
+    // Flip events also wake the thread, the loop goes back here if there is nothing else to do
+    repaintSemaphore.acquire();
+    dispatchFlipEvents();
+}
+
+void SRMRenderer::waitForPaintDeadline() noexcept
+{
+    // With VRR the frame is presented as soon as it's ready
+    if (conn->m_paintScheduling != SRMConnector::PaintScheduling::Deadline || !currentVSync || lastVblank.tv_sec == 0 || vrrActive())
+        return;
+
+    const clockid_t clock { device()->presentationClock() };
+    timespec ts;
+    clock_gettime(clock, &ts);
+
+    const Int64 now { ts.tv_sec * 1000000000LL + ts.tv_nsec };
+    Int64 nextVblank { predictNextVblank(now) };
+
+    if (nextVblank == 0)
+        return;
+
+    const Int64 period { static_cast<Int64>(scanoutMode()->period()) };
+
+    // The pending flip (N>2 buffers) takes the next vblank
+    if (pendingPageFlip)
+        nextVblank += period;
+
+    const Int64 deadline { nextVblank - static_cast<Int64>(paintCost()) - conn->m_paintDeadlineMargin * 1000LL };
+
+    // Already late or the estimate doesn't fit, paint now
+    if (deadline <= now || deadline - now >= 2 * period)
+        return;
+
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
+    while (clock_nanosleep(clock, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+}
+
+Int64 SRMRenderer::predictNextVblank(Int64 now) const noexcept
+{
+    if (!currentVSync || lastVblank.tv_sec == 0 || vrrActive())
+        return 0;
+
+    const Int64 period { static_cast<Int64>(scanoutMode()->period()) };
+
+    if (period == 0)
+        return 0;
+
+    const Int64 last { lastVblank.tv_sec * 1000000000LL + lastVblank.tv_nsec };
+
+    // The prediction drifts, only trust recent timestamps
+    if (now < last || now - last > 1000000000LL)
+        return 0;
+
+    return last + ((now - last) / period + 1) * period;
+}
+
+bool SRMRenderer::waitForCursorDeadline() noexcept
+{
+    // A cursor commit is still pending, the next one can't latch before the following vblank
+    if (pendingPageFlip)
+        waitPendingPageFlip(-1);
+
+    if (pendingRepaint)
+        return false;
+
+    timespec ts;
+    clock_gettime(device()->presentationClock(), &ts);
+    const Int64 now { ts.tv_sec * 1000000000LL + ts.tv_nsec };
+    const Int64 period { static_cast<Int64>(scanoutMode()->period()) };
+    Int64 target { predictNextVblank(now) };
+
+    // Unknown vblank (e.g. idle legacy connector), at least pace updates by the refresh period
+    if (target == 0)
+        target = cursorLatchVblank + period;
+
+    // Legacy moves have no flip event, don't target the same vblank twice
+    else if (target == cursorLatchVblank)
+        target += period;
+
+    // Too late for it, commit now
+    if (target - CursorLatchMargin <= now)
+    {
+        cursorLatchVblank = now + CursorLatchMargin;
+        return true;
+    }
+
+    cursorLatchVblank = target;
+
+    // Other requests (repaints, gamma, etc) wake the thread earlier
+    if (repaintSemaphore.try_acquire_for(std::chrono::nanoseconds(target - CursorLatchMargin - now)))
+    {
+        missedWake = true;
+
+        if (pendingRepaint)
+            return false;
+    }
+
+    return true;
+}
+
+bool SRMRenderer::latchCursor() noexcept
+{
+    if (!cursorLatchDirty.exchange(false, std::memory_order_acq_rel))
+        return false;
+
+    const UInt64 packed { cursorLatchPos.load(std::memory_order_acquire) };
+    cursorPos = SkIPoint::Make(static_cast<Int32>(packed >> 32), static_cast<Int32>(packed & 0xFFFFFFFF));
+
+    if (cursorAPI == CursorAPI::Atomic)
+        atomicChanges.add(CHCursorPosition);
+    else if (cursorAPI == CursorAPI::Legacy)
+        drmModeMoveCursor(device()->fd(), crtc->id(), cursorPlanePos().x(), cursorPlanePos().y());
+
+    return true;
+}
+
+void SRMRenderer::measurePaintCost() noexcept
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    framePaintCost = (now.tv_sec - paintStart.tv_sec) * 1000000000LL + (now.tv_nsec - paintStart.tv_nsec);
+}
+
+void SRMRenderer::updatePaintCost() noexcept
+{
+    paintCosts[paintCostsI] = framePaintCost;
 
-                    rend->iface->presented(rend->conn, (*it).info, frame->rend->ifaceData);
-                }
+    if (++paintCostsI == paintCosts.size())
+        paintCostsI = 0;
+}
 
-                it = rend->frameQueue.erase(it);
-                break;
-            }
-        }
-    }
+bool SRMRenderer::vrrActive() const noexcept
+{
+    return conn->m_vrr && currentVSync && crtc->m_propIDs.VRR_ENABLED;
 }
 
-void SRMRenderer::waitForRepaintRequest() noexcept
+void SRMRenderer::updateLFC() noexcept
 {
-    const bool needsWait { (!pendingRepaint && atomicChanges == 0) || device()->core()->isSuspended() };
+    const auto now { std::chrono::steady_clock::now() };
+    const auto interval { now - lastContentCommit };
+    lastContentCommit = now;
+    lfcRepeats = 0;
 
-    if (needsWait)
+    if (!vrrActive() || conn->m_vrrMinRefreshRate == 0 || interval > std::chrono::seconds(1))
     {
-        atomicChanges.set(0);
-        repaintSemaphore.acquire();
+        contentInterval = {};
+        return;
     }
+
+    // Smoothed to ignore single late frames
+    contentInterval = contentInterval.count() == 0 ? interval : (contentInterval * 3 + interval) / 4;
+
+    const std::chrono::nanoseconds maxPeriod { 1000000000LL / conn->m_vrrMinRefreshRate };
+    const std::chrono::nanoseconds minPeriod { conn->m_vrrMaxRefreshRate == 0 ? 0 : 1000000000LL / conn->m_vrrMaxRefreshRate };
+
+    if (contentInterval <= maxPeriod)
+        return;
+
+    // Present each frame k times so that the effective refresh rate stays within range
+    auto k { (contentInterval + maxPeriod - std::chrono::nanoseconds(1)) / maxPeriod };
+
+    while (k > 1 && contentInterval / k < minPeriod)
+        k--;
+
+    if (k <= 1)
+        return;
+
+    lfcStep = contentInterval / k;
+    lfcRepeats = k - 1;
+    lfcNextRepeat = now + lfcStep;
+}
+
+UInt64 SRMRenderer::paintCost() const noexcept
+{
+    // Rolling max, a single slow frame is enough to paint earlier
+    return *std::max_element(paintCosts.begin(), paintCosts.end());
 }
 
 bool SRMRenderer::waitPendingPageFlip(int iterLimit) noexcept
 {
-    pollfd fds {};
-    fds.fd = device()->fd();
-    fds.events = POLLIN;
+    dispatchFlipEvents();
 
-    if (pendingPageFlip)
+    while (pendingPageFlip)
     {
-        while (pendingPageFlip)
-        {
-            if (iterLimit == 0)
-                return false;
-
-            const std::lock_guard<std::recursive_mutex> lock { device()->m_pageFlipMutex };
-
-            // Double check if the pageflip was notified in another thread
-            if (!pendingPageFlip)
-                return true;
+        if (iterLimit == 0)
+            return false;
 
-            poll(&fds, 1, iterLimit == -1 ? 500 : 1);
-            drmHandleEvent(fds.fd, &drmEventCtx);
+        // The token may belong to a repaint request, waitForRepaintRequest() replays it
+        if (repaintSemaphore.try_acquire_for(std::chrono::milliseconds(iterLimit == -1 ? 500 : 1)))
+            missedWake = true;
 
-            if (iterLimit > 0)
-                iterLimit--;
-        }
-    }
-    else
-    {
-        const std::lock_guard<std::recursive_mutex> lock { device()->m_pageFlipMutex };
+        dispatchFlipEvents();
 
-        while (poll(&fds, 1, 0) > 0)
-            drmHandleEvent(fds.fd, &drmEventCtx);
+        if (iterLimit > 0)
+            iterLimit--;
     }
 
     return true;
@@ -882,26 +1872,37 @@ void SRMRenderer::commit(std::shared_ptr<RDRMFramebuffer> fb, bool notify) noexc
 
     int ret { 0 };
 
+    // Before waiting for the previous flip, otherwise the stall would move the paint deadline earlier
+    if (notify)
+    {
+        measurePaintCost();
+        updateAdaptiveBuffering();
+    }
+
     if (pendingPageFlip || swapchain.n == 1 || swapchain.n > 2)
         waitPendingPageFlip(-1);
 
+    const UInt64 allocs { SRMAllocCounter::Count() };
+
     if (device()->clientCaps().Atomic)
     {
         const std::lock_guard<std::recursive_mutex> lock { propsMutex };
+        latchCursor();
 
         const bool asyncFlip { !currentVSync && atomicChanges.get() == 0 && !primaryPlane->m_syncOnlyModifiers.contains(fb->modifier()) };
 
         // DRM_MODE_PAGE_FLIP_ASYNC only accepts changing the fb of the primary plane
         if (asyncFlip)
         {
-            auto req { SRMAtomicRequest::Make(device()) };
+            auto &req { frameReq };
             atomicReqAppendPrimaryPlane(req, fb);
             auto frame { enqueueCurrentFrame(notify ? CZPresentationTime::HWClock | CZPresentationTime::HWCompletion : 0) };
-            ret = req->commit(DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_PAGE_FLIP_ASYNC | DRM_MODE_ATOMIC_NONBLOCK, &(*frame), false);
+            ret = req->commit(DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_PAGE_FLIP_ASYNC | DRM_MODE_ATOMIC_NONBLOCK, frame, false);
+            req->reset();
 
             if (ret)
             {
-                frameQueue.erase(frame);
+                dequeueLastFrame();
 
                 // Even if async flips are supported some drivers may not handle specific modifiers and report EINVAL
                 if (ret == -EINVAL && fb->modifier() != DRM_FORMAT_MOD_INVALID)
@@ -915,37 +1916,90 @@ void SRMRenderer::commit(std::shared_ptr<RDRMFramebuffer> fb, bool notify) noexc
         // Sync flip
         if (!asyncFlip || ret)
         {
-            auto req { SRMAtomicRequest::Make(device()) };
-            atomicReqAppendChanges(req, fb);
+            auto *tmpl { patchTemplate(fb) };
+            auto &req { tmpl ? tmpl->req : frameReq };
+
+            if (!tmpl)
+                atomicReqAppendChanges(req, fb);
+
             const auto prevCursorIndex { cursorI };
+            const bool overlaysChanged { atomicChanges.has(CHOverlays) };
             auto frame { enqueueCurrentFrame(notify ? CZPresentationTime::HWClock | CZPresentationTime::HWCompletion | CZPresentationTime::VSync : 0) };
-            ret = req->commit(DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK, &(*frame), false);
+            frame->vsync = true;
+
+            bool grouped { false };
+
+            // Cursor, gamma, etc updates carry no new frame, don't make them wait for the other members
+            const bool contentFlip { notify || fb != currentFb };
+
+            if (commitGroup && contentFlip && !vrrActive())
+            {
+                groupFrame = frame;
+                grouped = commitGroup->submit(req.get()) == 0;
+
+                if (!grouped)
+                    groupFrame = nullptr;
+            }
+
+            // Not grouped or the group commit failed
+            if (grouped)
+                ret = 0;
+            else
+                ret = req->commit(DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK, frame, false);
+
+            if (tmpl)
+                req->clearAttachments();
+            else
+                req->reset();
 
             if (ret)
             {
-                frameQueue.erase(frame);
+                dequeueLastFrame();
                 if (cursorPlane)
                     cursorI = prevCursorIndex;
 
                 logAtomic(CZTrace, CZLN, "Failed to page flip. DRM Error: {}", strerror(-ret));
+
+                // A validated configuration may no longer fit (e.g. bandwidth used by other CRTCs)
+                if (ret == -EINVAL && (overlaysChanged || currentFb != fb))
+                    crtc->m_testCache.clear();
             }
             else
+            {
                 atomicChanges = 0;
+
+                if (overlaysChanged)
+                {
+                    // The previous buffers are scanned out until this flip completes
+                    overlayFbs[1].swap(overlayFbs[0]);
+                    overlayFbs[0].clear();
+
+                    for (const auto &overlay : overlays)
+                        overlayFbs[0].emplace_back(overlay.fb);
+
+                    releaseOverlayPlanes(false);
+                }
+            }
         }
     }
     else
     {
+        {
+            const std::lock_guard<std::recursive_mutex> lock { propsMutex };
+            latchCursor();
+        }
+
         const auto primaryPlaneFb { fb->id() };
         const bool asyncFlip { !currentVSync && !primaryPlane->m_syncOnlyModifiers.contains(fb->modifier()) };
 
         if (asyncFlip)
         {
             auto frame { enqueueCurrentFrame(notify ? CZPresentationTime::HWClock | CZPresentationTime::HWCompletion : 0) };
-            ret = drmModePageFlip(device()->fd(), crtc->id(), primaryPlaneFb, DRM_MODE_PAGE_FLIP_ASYNC | DRM_MODE_PAGE_FLIP_EVENT, &(*frame));
+            ret = drmModePageFlip(device()->fd(), crtc->id(), primaryPlaneFb, DRM_MODE_PAGE_FLIP_ASYNC | DRM_MODE_PAGE_FLIP_EVENT, frame);
 
             if (ret)
             {
-                frameQueue.erase(frame);
+                dequeueLastFrame();
 
                 // Even if async flips are supported some drivers may not handle specific modifiers and report EINVAL
                 if (ret == -EINVAL && fb->modifier() != DRM_FORMAT_MOD_INVALID)
@@ -959,11 +2013,12 @@ void SRMRenderer::commit(std::shared_ptr<RDRMFramebuffer> fb, bool notify) noexc
         if (!asyncFlip || ret)
         {
             auto frame { enqueueCurrentFrame(notify ? CZPresentationTime::HWClock | CZPresentationTime::HWCompletion | CZPresentationTime::VSync : 0) };
-            ret = drmModePageFlip(device()->fd(), crtc->id(), primaryPlaneFb, DRM_MODE_PAGE_FLIP_EVENT, &(*frame));
+            frame->vsync = true;
+            ret = drmModePageFlip(device()->fd(), crtc->id(), primaryPlaneFb, DRM_MODE_PAGE_FLIP_EVENT, frame);
 
             if (ret)
             {
-                frameQueue.erase(frame);
+                dequeueLastFrame();
                 logLegacy(CZTrace, CZLN, "Failed to page flip. DRM Error: {}", strerror(-ret));
             }
         }
@@ -972,12 +2027,26 @@ void SRMRenderer::commit(std::shared_ptr<RDRMFramebuffer> fb, bool notify) noexc
     if (ret)
     {
         if (notify)
+        {
+            const SRMAllocCounter::Pause pause;
             iface->discarded(conn, paintEventId, ifaceData);
+        }
     }
     else
     {
         currentFb = fb;
         pendingPageFlip = true;
+
+        if (notify)
+        {
+            updatePaintCost();
+            updateLFC();
+        }
+
+        checkFrameAllocs(allocs, "commit()");
+
+        if (allocCheckWarmup > 0)
+            allocCheckWarmup--;
     }
 
     if (swapchain.n == 2 || firstPageFlip)
@@ -987,18 +2056,66 @@ void SRMRenderer::commit(std::shared_ptr<RDRMFramebuffer> fb, bool notify) noexc
     }
 }
 
-std::list<SRMRenderer::Frame>::iterator SRMRenderer::enqueueCurrentFrame(CZBitset<CZPresentationTime::Flags> flags) noexcept
+SRMRenderer::Frame *SRMRenderer::enqueueCurrentFrame(CZBitset<CZPresentationTime::Flags> flags) noexcept
+{
+    // Never happens unless events are lost, drop the oldest
+    if (frameQueueSize == MaxQueuedFrames)
+    {
+        Frame &oldest { frameQueue[frameQueueHead] };
+
+        if (oldest.info.flags != 0)
+        {
+            const SRMAllocCounter::Pause pause;
+            iface->discarded(conn, oldest.info.paintEventId, ifaceData);
+        }
+
+        frameQueueHead = (frameQueueHead + 1) % MaxQueuedFrames;
+        frameQueueSize--;
+    }
+
+    Frame &frame { frameQueue[(frameQueueHead + frameQueueSize) % MaxQueuedFrames] };
+    frameQueueSize++;
+    frame.rend = this;
+    frame.info = {};
+    frame.info.flags = flags;
+    frame.info.paintEventId = paintEventId;
+    frame.vsync = flags.has(CZPresentationTime::VSync);
+    return &frame;
+}
+
+void SRMRenderer::dequeueLastFrame() noexcept
 {
-    frameQueue.emplace_back(Frame{.rend = this, .info = {}});
-    frameQueue.back().info.flags = flags;
-    frameQueue.back().info.paintEventId = paintEventId;
-    return std::prev(frameQueue.end());
+    if (frameQueueSize > 0)
+        frameQueueSize--;
+}
+
+void SRMRenderer::checkFrameAllocs(UInt64 start, const char *where) noexcept
+{
+    if constexpr (SRMAllocCounter::Enabled)
+    {
+        if (allocCheckWarmup > 0)
+            return;
+
+        const UInt64 allocs { SRMAllocCounter::Count() - start };
+
+        if (allocs == 0)
+            return;
+
+        log(CZFatal, CZLN, "{} heap allocation(s) in {} after warm-up", allocs, where);
+        assert(allocs == 0);
+    }
+    else
+    {
+        CZ_UNUSED(start);
+        CZ_UNUSED(where);
+    }
 }
 
 bool SRMRenderer::rendRender() noexcept
 {
     const auto currentImageRect { SkIRect::MakeSize(swapchain.image()->size()) };
     conn->damage.setRect(currentImageRect);
+    clock_gettime(CLOCK_MONOTONIC, &paintStart);
     paintEventId++;
     iface->paint(conn, ifaceData);
     conn->damage.op(currentImageRect, SkRegion::kIntersect_Op);
@@ -1023,14 +2140,23 @@ bool SRMRenderer::rendResume() noexcept
 void SRMRenderer::atomicReqAppendChanges(std::shared_ptr<SRMAtomicRequest> req, std::shared_ptr<RDRMFramebuffer> fb) noexcept
 {
     if (fb)
+    {
         atomicReqAppendPrimaryPlane(req, fb);
+        atomicReqAppendDamage(req, fb);
+    }
 
     if (atomicChanges.has(CHContentType))
         req->addProperty(conn->id(), conn->m_propIDs.content_type, static_cast<UInt64>(conn->contentType()));
 
+    if (atomicChanges.has(CHVRR))
+        req->addProperty(crtc->id(), crtc->m_propIDs.VRR_ENABLED, conn->m_vrr);
+
     if (atomicChanges.has(CHGammaLUT))
         req->addProperty(crtc->id(), crtc->m_propIDs.GAMMA_LUT, gammaBlob ? gammaBlob->id() : 0);
 
+    if (atomicChanges.has(CHOverlays))
+        atomicReqAppendOverlays(req);
+
     if (cursorAPI == CursorAPI::Atomic)
     {
         bool updatedFB { false };
@@ -1058,14 +2184,8 @@ void SRMRenderer::atomicReqAppendChanges(std::shared_ptr<SRMAtomicRequest> req,
                     req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.FB_ID, cursor[cursorI].fb->id());
 
                 req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_ID, crtc->id());
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_X, cursorPos.x());
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_Y, cursorPos.y());
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_W, 64);
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_H, 64);
                 req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.SRC_X, 0);
                 req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.SRC_Y, 0);
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.SRC_W, (UInt64)64 << 16);
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.SRC_H, (UInt64)64 << 16);
             }
             else
             {
@@ -1074,13 +2194,20 @@ void SRMRenderer::atomicReqAppendChanges(std::shared_ptr<SRMAtomicRequest> req,
             }
         }
 
-        if (atomicChanges.has(CHCursorPosition))
+        // A new buffer may come with a different size and hotspot
+        if (cursorVisible && (updatedFB || updatedVisibility))
         {
-            if (!updatedVisibility)
-            {
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_X, cursorPos.x());
-                req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_Y, cursorPos.y());
-            }
+            const auto &cur { cursor[cursorI] };
+            req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_W, cur.planeSize.width());
+            req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_H, cur.planeSize.height());
+            req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.SRC_W, (UInt64)cur.planeSize.width() << 16);
+            req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.SRC_H, (UInt64)cur.planeSize.height() << 16);
+        }
+
+        if (cursorVisible && (updatedFB || updatedVisibility || atomicChanges.has(CHCursorPosition)))
+        {
+            req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_X, cursorPlanePos().x());
+            req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_Y, cursorPlanePos().y());
         }
     } 
 }
@@ -1098,6 +2225,180 @@ void SRMRenderer::atomicReqAppendPrimaryPlane(std::shared_ptr<SRMAtomicRequest>
     req->attachFd(inFence.release());
 }
 
+void SRMRenderer::atomicReqAppendDamage(std::shared_ptr<SRMAtomicRequest> req, std::shared_ptr<RDRMFramebuffer> fb) noexcept
+{
+    if (!primaryPlane->m_propIDs.FB_DAMAGE_CLIPS)
+        return;
+
+    // Not setting the property means full damage
+    auto blob { damageBlobFor(fb) };
+
+    if (!blob)
+        return;
+
+    req->attachPropertyBlob(blob);
+    req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.FB_DAMAGE_CLIPS, blob->id());
+}
+
+std::shared_ptr<SRMPropertyBlob> SRMRenderer::damageBlobFor(std::shared_ptr<RDRMFramebuffer> fb) noexcept
+{
+    // Cursor, gamma, LFC, etc updates: nothing changed (a blob can't be empty, so use a zero-area rect)
+    if (fb == currentFb)
+    {
+        if (!emptyDamageBlob)
+        {
+            const drm_mode_rect empty {};
+            emptyDamageBlob = SRMPropertyBlob::MakeUncached(device(), &empty, sizeof(empty));
+        }
+
+        return emptyDamageBlob;
+    }
+
+    if (conn->damage.isEmpty() || conn->damage.getBounds() == SkIRect::MakeSize(swapchain.image()->size()))
+        return {};
+
+    damageRectsTmp.clear();
+
+    if (conn->damage.computeRegionComplexity() > Int32(MaxMergeableDamageRects))
+    {
+        const auto &b { conn->damage.getBounds() };
+        damageRectsTmp.push_back({ b.left(), b.top(), b.right(), b.bottom() });
+    }
+    else
+    {
+        for (SkRegion::Iterator it(conn->damage); !it.done(); it.next())
+            damageRectsTmp.push_back({ it.rect().left(), it.rect().top(), it.rect().right(), it.rect().bottom() });
+
+        MergeDamageRects(damageRectsTmp, MaxDamageRects);
+    }
+
+    const bool reuse { damageBlob && damageRects.size() == damageRectsTmp.size() &&
+        memcmp(damageRects.data(), damageRectsTmp.data(), damageRects.size() * sizeof(drm_mode_rect)) == 0 };
+
+    if (!reuse)
+    {
+        const size_t size { damageRectsTmp.size() * sizeof(drm_mode_rect) };
+
+        // Clips rarely repeat, so they bypass the blob cache (misses would allocate here)
+        // Not referenced by any request, replace its contents instead of allocating a new one
+        if (!damageBlob || damageBlob.use_count() > 1 || !damageBlob->update(damageRectsTmp.data(), size))
+            damageBlob = SRMPropertyBlob::MakeUncached(device(), damageRectsTmp.data(), size);
+
+        if (!damageBlob)
+        {
+            damageRects.clear();
+            logAtomic(CZTrace, CZLN, "Failed to create FB_DAMAGE_CLIPS blob");
+            return {};
+        }
+
+        std::swap(damageRects, damageRectsTmp);
+    }
+
+    return damageBlob;
+}
+
+void SRMRenderer::initTemplates() noexcept
+{
+    templatesValid = true;
+
+    auto build = [this](RequestTemplate &t, bool flip, bool cursorMove)
+    {
+        if (t.req)
+            t.req->reset();
+        else
+            t.req = SRMAtomicRequest::Make(device());
+
+        t = { .req = t.req };
+
+        if (flip)
+        {
+            t.req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.FB_ID, 0);
+
+            if (primaryPlane->m_propIDs.IN_FENCE_FD)
+                t.req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.IN_FENCE_FD, -1);
+
+            // 0 means full damage
+            if (primaryPlane->m_propIDs.FB_DAMAGE_CLIPS)
+                t.req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.FB_DAMAGE_CLIPS, 0);
+
+            t.fbId = t.req->value(primaryPlane->id(), primaryPlane->m_propIDs.FB_ID);
+            t.inFence = t.req->value(primaryPlane->id(), primaryPlane->m_propIDs.IN_FENCE_FD);
+            t.damage = t.req->value(primaryPlane->id(), primaryPlane->m_propIDs.FB_DAMAGE_CLIPS);
+        }
+
+        if (cursorMove)
+        {
+            t.req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_X, 0);
+            t.req->addProperty(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_Y, 0);
+            t.cursorX = t.req->value(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_X);
+            t.cursorY = t.req->value(cursorPlane->id(), cursorPlane->m_propIDs.CRTC_Y);
+        }
+    };
+
+    build(flipTemplate, true, false);
+
+    if (cursorAPI == CursorAPI::Atomic)
+    {
+        build(cursorTemplate, false, true);
+        build(flipCursorTemplate, true, true);
+    }
+    else
+    {
+        cursorTemplate = {};
+        flipCursorTemplate = {};
+    }
+}
+
+SRMRenderer::RequestTemplate *SRMRenderer::patchTemplate(std::shared_ptr<RDRMFramebuffer> fb) noexcept
+{
+    if (!templatesValid)
+        initTemplates();
+
+    RequestTemplate *t;
+
+    if (atomicChanges.get() == 0)
+        t = &flipTemplate;
+    else if (atomicChanges.get() == CHCursorPosition && cursorTemplate.req)
+    {
+        // A hidden cursor plane has no CRTC, the commit would produce no page flip event
+        if (fb == currentFb && cursorVisible)
+            t = &cursorTemplate;
+        else
+            t = &flipCursorTemplate;
+    }
+    else
+        return nullptr;
+
+    if (t->fbId)
+    {
+        *t->fbId = fb->id();
+
+        if (t->inFence)
+        {
+            *t->inFence = static_cast<UInt64>(inFence.get());
+
+            // Closed after the commit by clearAttachments()
+            t->req->attachFd(inFence.release());
+        }
+        else
+            inFence.reset();
+
+        if (t->damage)
+        {
+            auto blob { damageBlobFor(fb) };
+            *t->damage = blob ? blob->id() : 0;
+        }
+    }
+
+    if (t->cursorX)
+    {
+        *t->cursorX = static_cast<UInt64>(cursorPlanePos().x());
+        *t->cursorY = static_cast<UInt64>(cursorPlanePos().y());
+    }
+
+    return t;
+}
+
 void SRMRenderer::atomicReqAppendDisable(std::shared_ptr<SRMAtomicRequest> req) noexcept
 {
     req->addProperty(crtc->id(), crtc->m_propIDs.ACTIVE, 0);
@@ -1105,6 +2406,217 @@ void SRMRenderer::atomicReqAppendDisable(std::shared_ptr<SRMAtomicRequest> req)
     req->addProperty(conn->id(), conn->m_propIDs.CRTC_ID, 0);
     req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.CRTC_ID, 0);
     req->addProperty(primaryPlane->id(), primaryPlane->m_propIDs.FB_ID, 0);
+
+    for (auto *plane : overlayPlanes)
+    {
+        req->addProperty(plane->id(), plane->m_propIDs.CRTC_ID, 0);
+        req->addProperty(plane->id(), plane->m_propIDs.FB_ID, 0);
+    }
+}
+
+UInt32 SRMRenderer::assignOverlays(std::vector<SRMOverlayLayer> &layers) noexcept
+{
+    for (auto &layer : layers)
+        layer.assigned = false;
+
+    if (!overlays.empty() || !overlayPlanes.empty())
+        atomicChanges.add(CHOverlays);
+
+    overlays.clear();
+
+    if (!device()->clientCaps().Atomic || isDead || layers.empty())
+        return 0;
+
+    if (!overlayTestReq)
+        overlayTestReq = SRMAtomicRequest::Make(device());
+
+    UInt32 assigned { 0 };
+
+    // Greedy, layers are tried in the given order (by priority) on each compatible plane
+    for (auto &layer : layers)
+    {
+        if (!layer.image || layer.alpha <= 0.f || layer.srcRect.isEmpty() || layer.dstRect.isEmpty())
+            continue;
+
+        const auto format { layer.image->formatInfo().format };
+        SRMFramebufferCache::Layout layout;
+        auto fb { device()->m_fbCache.get(layer.image, format, &layout) };
+
+        if (!fb)
+            continue;
+
+        const auto modifier { layer.image->modifier() };
+
+        for (auto *plane : device()->planes())
+        {
+            if (plane->type() != SRMPlane::Overlay ||
+                plane->leased() ||
+                !plane->formats().has(format, modifier) ||
+                (layer.alpha < 1.f && !plane->m_propIDs.alpha) ||
+                std::find(plane->crtcs().begin(), plane->crtcs().end(), crtc) == plane->crtcs().end() ||
+                std::any_of(overlays.begin(), overlays.end(), [plane](const Overlay &o){ return o.plane == plane; }) ||
+                !claimOverlayPlane(plane))
+                continue;
+
+            overlays.emplace_back(Overlay {
+                .plane = plane,
+                .fb = fb,
+                .format = format,
+                .modifier = modifier,
+                .layout = layout,
+                .src = layer.srcRect,
+                .dst = layer.dstRect,
+                .zOrder = layer.zOrder,
+                .alpha = static_cast<UInt64>(std::clamp(layer.alpha, 0.f, 1.f) * 0xFFFF),
+                .zpos = 0 });
+
+            updateOverlayZpos();
+            overlayTestReq->reset();
+            atomicReqAppendOverlays(overlayTestReq);
+
+            if (testCommit(overlayTestReq, overlaysTestKey()) == 0)
+            {
+                layer.assigned = true;
+                assigned++;
+                break;
+            }
+
+            overlays.pop_back();
+        }
+    }
+
+    updateOverlayZpos();
+    overlayTestReq->reset();
+
+    if (assigned > 0)
+        atomicChanges.add(CHOverlays);
+
+    return assigned;
+}
+
+bool SRMRenderer::claimOverlayPlane(SRMPlane *plane) noexcept
+{
+    if (std::find(overlayPlanes.begin(), overlayPlanes.end(), plane) != overlayPlanes.end())
+        return true;
+
+    const std::lock_guard<std::mutex> lock { device()->m_overlayPlanesMutex };
+
+    if (plane->currentConnector())
+        return false;
+
+    plane->m_currentConnector = conn;
+    overlayPlanes.emplace_back(plane);
+    return true;
+}
+
+void SRMRenderer::releaseOverlayPlanes(bool all) noexcept
+{
+    if (overlayPlanes.empty())
+        return;
+
+    const std::lock_guard<std::mutex> lock { device()->m_overlayPlanesMutex };
+
+    std::erase_if(overlayPlanes, [this, all](SRMPlane *plane) {
+        if (!all && std::any_of(overlays.begin(), overlays.end(), [plane](const Overlay &o){ return o.plane == plane; }))
+            return false;
+
+        plane->m_currentConnector = nullptr;
+        return true;
+    });
+}
+
+void SRMRenderer::updateOverlayZpos() noexcept
+{
+    // Rank by zOrder, the primary plane is usually at 0
+    for (auto &overlay : overlays)
+    {
+        overlay.zpos = 1;
+
+        for (const auto &other : overlays)
+            if (other.zOrder < overlay.zOrder || (other.zOrder == overlay.zOrder && &other < &overlay))
+                overlay.zpos++;
+    }
+}
+
+int SRMRenderer::testCommit(std::shared_ptr<SRMAtomicRequest> req, const SRMTestCache::Key &key) noexcept
+{
+    int ret;
+
+    if (crtc->m_testCache.find(key, &ret))
+        return ret;
+
+    ret = req->commit(DRM_MODE_ATOMIC_TEST_ONLY, nullptr, false);
+    crtc->m_testCache.store(key, ret);
+    return ret;
+}
+
+SRMTestCache::Key SRMRenderer::overlaysTestKey() const noexcept
+{
+    SRMTestCache::Key key;
+    key.add('O');
+
+    // Planes being disabled are part of the configuration too
+    for (auto *plane : overlayPlanes)
+        key.add(plane->id());
+
+    for (const auto &o : overlays)
+    {
+        key.add(o.plane->id())
+           .add(o.format)
+           .add(o.modifier)
+           .add(static_cast<UInt64>(o.src.x() * 65536.f))
+           .add(static_cast<UInt64>(o.src.y() * 65536.f))
+           .add(static_cast<UInt64>(o.src.width() * 65536.f))
+           .add(static_cast<UInt64>(o.src.height() * 65536.f))
+           .add(static_cast<UInt64>(o.dst.x()))
+           .add(static_cast<UInt64>(o.dst.y()))
+           .add(static_cast<UInt64>(o.dst.width()))
+           .add(static_cast<UInt64>(o.dst.height()))
+           .add(o.alpha)
+           .add(o.zpos)
+           .add(o.layout.planeCount);
+
+        for (UInt32 i = 0; i < o.layout.planeCount; i++)
+            key.add(o.layout.pitches[i]).add(o.layout.offsets[i]);
+    }
+
+    return key;
+}
+
+void SRMRenderer::atomicReqAppendOverlays(std::shared_ptr<SRMAtomicRequest> req) noexcept
+{
+    for (auto *plane : overlayPlanes)
+    {
+        if (std::any_of(overlays.begin(), overlays.end(), [plane](const Overlay &o){ return o.plane == plane; }))
+            continue;
+
+        req->addProperty(plane->id(), plane->m_propIDs.CRTC_ID, 0);
+        req->addProperty(plane->id(), plane->m_propIDs.FB_ID, 0);
+    }
+
+    for (const auto &o : overlays)
+    {
+        const UInt32 id { o.plane->id() };
+        const auto &props { o.plane->m_propIDs };
+        req->addProperty(id, props.FB_ID, o.fb->id());
+        req->addProperty(id, props.CRTC_ID, crtc->id());
+        req->addProperty(id, props.CRTC_X, static_cast<UInt64>(o.dst.x()));
+        req->addProperty(id, props.CRTC_Y, static_cast<UInt64>(o.dst.y()));
+        req->addProperty(id, props.CRTC_W, o.dst.width());
+        req->addProperty(id, props.CRTC_H, o.dst.height());
+
+        // 16.16 fixed point
+        req->addProperty(id, props.SRC_X, static_cast<UInt64>(o.src.x() * 65536.f));
+        req->addProperty(id, props.SRC_Y, static_cast<UInt64>(o.src.y() * 65536.f));
+        req->addProperty(id, props.SRC_W, static_cast<UInt64>(o.src.width() * 65536.f));
+        req->addProperty(id, props.SRC_H, static_cast<UInt64>(o.src.height() * 65536.f));
+
+        if (props.alpha)
+            req->addProperty(id, props.alpha, o.alpha);
+
+        if (props.zpos)
+            req->addProperty(id, props.zpos, o.zpos);
+    }
 }
 
 void SRMRenderer::logInfo() noexcept
@@ -1116,13 +2628,13 @@ void SRMRenderer::logInfo() noexcept
         SRMLog(CZInfo, "---------------- Connector Initialized ----------------");
         SRMLog(CZInfo, "Name: {} {} {}", conn->name(), conn->model(), conn->make());
         SRMLog(CZInfo, "Mode: {} x {} @ {}", conn->currentMode()->size().width(), conn->currentMode()->size().height(), conn->currentMode()->refreshRate());
-        SRMLog(CZInfo, "Strategy: {}", StrategyString(strategy));
+        SRMLog(CZInfo, "Strategy: {}{}", StrategyString(strategy), swapchain.zeroCopy ? " (Zero-Copy)" : "");
         SRMLog(CZInfo, "DRM API: {}", device()->clientCaps().Atomic ? "Atomic" : "Legacy");
         SRMLog(CZInfo, "Device: {} - {}", device()->nodeName(), device()->reamDevice()->drmDriverName());
         SRMLog(CZInfo, "Renderer: {} - {}", ream->mainDevice()->srmDevice()->nodeName(), ream->mainDevice()->drmDriverName());
         SRMLog(CZInfo, "Surface Format: {} - {}", RDRMFormat::FormatName(swapchain.images[0]->formatInfo().format), RDRMFormat::ModifierName(swapchain.images[0]->modifier()));
         SRMLog(CZInfo, "Buffering: {}", swapchain.n);
-        SRMLog(CZInfo, "Cursor Plane: {}", cursor[0].bo != nullptr);
+        SRMLog(CZInfo, "Cursor Plane: {} ({}x{})", cursor[0].bo != nullptr, cursorBufferSize.width(), cursorBufferSize.height());
         SRMLog(CZInfo, "-------------------------------------------------------\n");
     }
 }
@@ -6,9 +6,16 @@
 #include <CZ/Core/CZWeak.h>
 #include <CZ/Core/CZPresentationTime.h>
 #include <CZ/skia/core/SkPoint.h>
+#include <CZ/skia/core/SkRegion.h>
 #include <CZ/SRM/SRMPropertyBlob.h>
+#include <CZ/SRM/SRMPixelTransfer.h>
+#include <CZ/SRM/SRMEventReactor.h>
+#include <CZ/SRM/SRMTestCache.h>
+#include <CZ/SRM/SRMFramebufferCache.h>
 #include <CZ/Ream/Ream.h>
 
+#include <array>
+#include <chrono>
 #include <future>
 #include <mutex>
 #include <memory>
@@ -27,7 +34,9 @@ public:
         CHCursorPosition   = 1 << 1,
         CHCursorBuffer     = 1 << 2,
         CHGammaLUT         = 1 << 3,
-        CHContentType      = 1 << 4
+        CHContentType      = 1 << 4,
+        CHVRR              = 1 << 5,
+        CHOverlays         = 1 << 6
     };
 
     enum Strategy
@@ -48,6 +57,7 @@ public:
     {
         SRMRenderer *rend;
         CZPresentationTime info;
+        bool vsync; // Sync flip, the event timestamp is a vblank even if info.flags is 0
     };
 
     struct Swapchain
@@ -56,6 +66,7 @@ public:
         UInt32 age {};
         UInt32 frame { 0 };
         UInt32 n { 2 };
+        bool zeroCopy { false }; // Dumb strategy painting directly into the scanout buffers
 
         void advanceAge() noexcept
         {
@@ -67,6 +78,29 @@ public:
         void resetAge() noexcept
         {
             frame = i = age = 0;
+            damageHistoryI = damageHistorySize = 0;
+        }
+
+        // Stores the damage of the frame just flipped
+        void pushDamage(const SkRegion &damage) noexcept
+        {
+            damageHistory[damageHistoryI].setRegion(damage);
+            damageHistoryI = (damageHistoryI + 1) % damageHistory.size();
+
+            if (damageHistorySize < damageHistory.size())
+                damageHistorySize++;
+        }
+
+        // Adds the damage of the last age - 1 frames to region, false if unknown (full damage)
+        bool damageSince(UInt32 age, SkRegion &region) const noexcept
+        {
+            if (age == 0 || age - 1 > damageHistorySize)
+                return false;
+
+            for (UInt32 j = 1; j < age; j++)
+                region.op(damageHistory[(damageHistoryI + damageHistory.size() - j) % damageHistory.size()], SkRegion::kUnion_Op);
+
+            return true;
         }
 
         auto fb() const noexcept { return fbs[i]; }
@@ -82,6 +116,11 @@ public:
         std::vector<std::shared_ptr<RImage>> primeImages;
         std::vector<std::shared_ptr<RSurface>> primeSurfaces;
         std::vector<std::shared_ptr<RDumbBuffer>> dumbBuffers;
+
+        // Frame damage ring, index damageHistoryI - 1 is the most recent
+        std::array<SkRegion, 4> damageHistory;
+        UInt32 damageHistoryI {};
+        UInt32 damageHistorySize {};
     };
 
     static std::string_view StrategyString(Strategy strategy) noexcept
@@ -99,27 +138,116 @@ public:
     void initContentType() noexcept;
     void initGamma() noexcept;
     void initCursor() noexcept;
+    SkISize cursorPlaneSize(SkISize imageSize) const noexcept;
+    SkIPoint cursorPlanePos() const noexcept { return cursorPos - cursor[cursorI].hotspot; }
+    void initVRR() noexcept;
     bool applyCrtcMode() noexcept;
 
+    // MODE_ID of the CRTC if it is active with the resolution of the current mode, 0 otherwise
+    // sameTimings is set if the refresh timings match as well
+    UInt32 committedModeBlob(bool *sameTimings) noexcept;
+
+    // Changes MODE_ID without ALLOW_MODESET, keeping the swapchain and planes
+    int commitSeamlessMode(const SRMConnectorMode *mode) noexcept;
+
+    // Idle refresh rate (SRMConnector::enableIdleRefreshRate())
+    bool canEnterIdleMode() const noexcept;
+    void enterIdleMode() noexcept;
+    void leaveIdleMode() noexcept;
+
+    // Mode the CRTC is scanning out, differs from the current one while idle
+    const SRMConnectorMode *scanoutMode() const noexcept;
+
     bool startRenderThread() noexcept;
 
+    // Allocates targetBufferCount() buffers, falling back to 2 if that fails
     bool initSwapchain() noexcept;
+    bool initSwapchain(UInt32 n) noexcept;
+
+    // Returns the buffers of sc to the device's pool, except the one scanned out unless includeCurrent
+    void recycleSwapchain(Swapchain &sc, Strategy scStrategy, bool includeCurrent) noexcept;
+    bool initSwapchainPooled() noexcept;
     bool initSwapchainSelf() noexcept;
     bool initSwapchainPrime() noexcept;
     bool initSwapchainDumb() noexcept;
 
+    // Sets up the parallel transfer if the Dumb swapchain images need a format conversion
+    void initDumbTransfer() noexcept;
+    bool initSwapchainDumbZeroCopy(const std::vector<const RDRMFormat*> &formats) noexcept;
+
+    // Number of buffers requested by the connector and the adaptive policy
+    UInt32 targetBufferCount() const noexcept;
+
+    // Reallocates the swapchain if targetBufferCount() changed
+    void updateBufferCount() noexcept;
+
+    // Switches to N>2 buffering after a few frames exceed the refresh period
+    void updateAdaptiveBuffering() noexcept;
+
+    // Validates image against the primary plane and sets it as the scanout buffer of the current frame
+    bool setScanoutImage(std::shared_ptr<RImage> image) noexcept;
+    void flipPageCustom() noexcept;
+
     bool flipPage() noexcept;
     bool flipPageSelf() noexcept;
     bool flipPagePrime() noexcept;
     bool flipPageDumb() noexcept;
 
     static void PageFlipHandler(Int32 fd, UInt32 seq, UInt32 sec, UInt32 usec, void *data) noexcept;
+
+    // Handles the flip events queued by the device's SRMEventReactor
+    void dispatchFlipEvents() noexcept;
     void waitForRepaintRequest() noexcept;
+
+    // Sleeps until the predicted paint deadline (SRMConnector::PaintScheduling::Deadline)
+    void waitForPaintDeadline() noexcept;
+
+    // Predicted timestamp of the next vblank in device()->presentationClock() ns, 0 if unknown
+    Int64 predictNextVblank(Int64 now) const noexcept;
+
+    // Waits until shortly before the next vblank, false if a repaint was requested meanwhile
+    bool waitForCursorDeadline() noexcept;
+
+    // Applies the position stored by SRMConnector::setCursorPos(), true if it changed
+    bool latchCursor() noexcept;
+
+    // conn->damage + the damage the current buffer missed (Prime and Dumb copies)
+    const SkRegion &copyRegion() noexcept;
+
+    // Measures the paint + flip preparation duration of the current frame, excluding the wait for the previous flip
+    void measurePaintCost() noexcept;
+
+    // Stores the measured cost of the current frame
+    void updatePaintCost() noexcept;
+    UInt64 paintCost() const noexcept;
+
+    // VRR enabled and applicable to the current frame
+    bool vrrActive() const noexcept;
+
+    // Schedules low framerate compensation repeats after a content flip
+    void updateLFC() noexcept;
     bool waitPendingPageFlip(int iterLimit) noexcept;
     void commit(std::shared_ptr<RDRMFramebuffer> fb, bool notify) noexcept;
 
     // Adds the current paint event to a "to be presented" frame queue
-    std::list<Frame>::iterator enqueueCurrentFrame(CZBitset<CZPresentationTime::Flags> flags) noexcept;
+    Frame *enqueueCurrentFrame(CZBitset<CZPresentationTime::Flags> flags) noexcept;
+
+    // Removes the last enqueued frame (e.g. if the commit failed)
+    void dequeueLastFrame() noexcept;
+
+    // Logs and asserts if heap allocations happened since start after the warm-up frames (see SRMAllocCounter)
+    void checkFrameAllocs(UInt64 start, const char *where) noexcept;
+
+    // Assigns layers to free overlay planes validated with DRM_MODE_ATOMIC_TEST_ONLY
+    UInt32 assignOverlays(std::vector<SRMOverlayLayer> &layers) noexcept;
+    bool claimOverlayPlane(SRMPlane *plane) noexcept;
+    void releaseOverlayPlanes(bool all) noexcept;
+    void updateOverlayZpos() noexcept;
+    void atomicReqAppendOverlays(std::shared_ptr<SRMAtomicRequest> req) noexcept;
+
+    // TEST_ONLY commit of req, answered by crtc->m_testCache if key was already tested
+    int testCommit(std::shared_ptr<SRMAtomicRequest> req, const SRMTestCache::Key &key) noexcept;
+    SRMTestCache::Key overlaysTestKey() const noexcept;
 
     bool rendRender() noexcept;
     bool rendUpdateMode() noexcept;
@@ -131,6 +259,29 @@ public:
     void atomicReqAppendPrimaryPlane(std::shared_ptr<SRMAtomicRequest> req, std::shared_ptr<RDRMFramebuffer> fb) noexcept;
     void atomicReqAppendDisable(std::shared_ptr<SRMAtomicRequest> req) noexcept;
 
+    // Attaches conn->damage as FB_DAMAGE_CLIPS, or an empty clip if fb is already being presented
+    void atomicReqAppendDamage(std::shared_ptr<SRMAtomicRequest> req, std::shared_ptr<RDRMFramebuffer> fb) noexcept;
+
+    // FB_DAMAGE_CLIPS blob for fb, nullptr means full damage
+    std::shared_ptr<SRMPropertyBlob> damageBlobFor(std::shared_ptr<RDRMFramebuffer> fb) noexcept;
+
+    // Prebuilt requests for the most frequent commits, only their values are patched
+    struct RequestTemplate
+    {
+        std::shared_ptr<SRMAtomicRequest> req;
+        UInt64 *fbId {};
+        UInt64 *inFence {};
+        UInt64 *damage {};
+        UInt64 *cursorX {};
+        UInt64 *cursorY {};
+    };
+
+    // Rebuilds the templates, required after a mode or plane change
+    void initTemplates() noexcept;
+
+    // Patches the template matching fb and atomicChanges, nullptr if the generic path is required
+    RequestTemplate *patchTemplate(std::shared_ptr<RDRMFramebuffer> fb) noexcept;
+
     void logInfo() noexcept;
 
     SRMDevice *device() const noexcept;
@@ -143,15 +294,24 @@ public:
     CZLogger logAtomic;
     CZLogger logLegacy;
 
-    Strategy strategy;
+    Strategy strategy { Self };
 
     struct Cursor
     {
         std::shared_ptr<RGBMBo> bo;
         std::shared_ptr<RDRMFramebuffer> fb;
+        SkISize planeSize {}; // CRTC/SRC size, the image is placed at the top-left corner of the bo
+        SkIPoint hotspot {};
     } cursor[2] {};
+    SkISize cursorBufferSize {}; // Max image size
+    std::vector<UInt8> cursorStaging; // Image padded to the bo stride
     Int32 cursorI { 1 };
     SkIPoint cursorPos {};
+
+    // Written by setCursorPos() from any thread, latched by the render thread at most once per commit
+    std::atomic<UInt64> cursorLatchPos {}; // x << 32 | y
+    std::atomic<bool> cursorLatchDirty {};
+    Int64 cursorLatchVblank {}; // Vblank targeted by the last cursor-only update
     CursorAPI cursorAPI { CursorAPI::None };
     bool cursorVisible { false };
 
@@ -172,12 +332,49 @@ public:
     std::shared_ptr<const RGammaLUT> gammaLUT;
     std::shared_ptr<SRMPropertyBlob> gammaBlob;
 
-    drmEventContext drmEventCtx {};
+    // FB_DAMAGE_CLIPS
+    std::vector<drm_mode_rect> damageRects; // Rects of damageBlob
+    std::vector<drm_mode_rect> damageRectsTmp;
+    std::shared_ptr<SRMPropertyBlob> damageBlob;
+    std::shared_ptr<SRMPropertyBlob> emptyDamageBlob;
+    SkRegion copyDamage;
+
+    // Overlay planes, see SRMConnector::setOverlayLayers()
+    struct Overlay
+    {
+        SRMPlane *plane;
+        std::shared_ptr<RDRMFramebuffer> fb;
+        RFormat format;
+        RModifier modifier;
+        SRMFramebufferCache::Layout layout;
+        SkRect src;
+        SkIRect dst;
+        Int32 zOrder;
+        UInt64 alpha; // 0xFFFF = opaque
+        UInt64 zpos;
+    };
+    std::vector<Overlay> overlays; // Applied by the next commit if CHOverlays is set
+    std::vector<SRMPlane*> overlayPlanes; // Claimed, the ones without overlay are disabled and released by the next commit
+    std::vector<std::shared_ptr<RDRMFramebuffer>> overlayFbs[2]; // Scanned out by the last two overlay changes
+    std::shared_ptr<SRMAtomicRequest> overlayTestReq;
+
+    // Set while initialized if the connector belongs to a group
+    std::shared_ptr<SRMCommitGroup> commitGroup;
+    Frame *groupFrame {}; // Frame of the last group commit, its event carries the group as user data
+
+    // Filled by the SRMEventReactor, which also releases repaintSemaphore
+    SRMEventReactor::FlipQueue flipQueue;
     std::binary_semaphore repaintSemaphore { 0 };
+    bool missedWake { false }; // repaintSemaphore acquired while waiting for a flip
     std::recursive_mutex propsMutex; // Protect stuff like cursor and gamma updates
     std::unique_ptr<SkRegion> m_damage;
     RFormat m_currentFormat {};
-    std::shared_ptr<RImage> m_userScanoutBuffers[2] {};
+
+    // Direct scanout, see SRMConnector::setCustomScanoutImage()
+    std::shared_ptr<RImage> pendingScanoutImage; // Set during the current paint event
+    std::shared_ptr<RDRMFramebuffer> pendingScanoutFb;
+    std::shared_ptr<RImage> m_userScanoutBuffers[2] {}; // Committed by the last two frames (null if from the swapchain)
+    bool scanoutActive { false }; // The last frame bypassed the swapchain
 
     std::shared_ptr<RDRMFramebuffer> currentFb; // Currently being presented
 
@@ -185,8 +382,55 @@ public:
     void *ifaceData;
 
     Swapchain swapchain {};
+
+    // Dumb strategy readback + parallel copy
+    std::unique_ptr<SRMPixelTransfer> transfer;
+    SRMPixelTransfer::Stats transferStats {}; // Copied after each transfer, read by SRMConnector::transferStats()
+    mutable std::mutex transferStatsMutex;
+    std::vector<UInt8> staging;
+    UInt32 stagingStride {};
+    UInt32 rejectedBufferCount {}; // Last buffer count that failed to allocate
+
+    // Paint scheduling
+    timespec paintStart {};
+    timespec lastVblank {}; // Timestamp of the last vsync'd page flip (0 if unknown)
+    Int64 framePaintCost {}; // See measurePaintCost()
+    std::array<UInt64, 16> paintCosts {};
+    UInt32 paintCostsI {};
+
+    // Low framerate compensation (VRR)
+    std::chrono::steady_clock::time_point lastContentCommit {};
+    std::chrono::steady_clock::time_point lfcNextRepeat {};
+    std::chrono::nanoseconds contentInterval {};
+    std::chrono::nanoseconds lfcStep {};
+    UInt32 lfcRepeats {};
+
+    // Adaptive buffering
+    UInt32 missedFrames {};
+    bool adaptiveBoost { false };
+
+    // Idle refresh rate, reset by applyCrtcMode()
+    CZWeak<SRMConnectorMode> idleMode;
+    bool idleModeUnavailable { false };
+
+    SkISize swapchainSize {}; // Mode size the swapchain was allocated for
+
     UInt64 paintEventId { 0 };
-    std::list<Frame> frameQueue;
+
+    // Frames waiting for their page flip event, oldest first
+    static constexpr UInt32 MaxQueuedFrames { 8 };
+    std::array<Frame, MaxQueuedFrames> frameQueue {};
+    UInt32 frameQueueHead {};
+    UInt32 frameQueueSize {};
+
+    // Reused by the per-frame commit path, cleared after each commit
+    std::shared_ptr<SRMAtomicRequest> frameReq;
+    RequestTemplate flipTemplate;       // Primary plane FB_ID, IN_FENCE_FD and FB_DAMAGE_CLIPS
+    RequestTemplate cursorTemplate;     // Cursor plane CRTC_X and CRTC_Y
+    RequestTemplate flipCursorTemplate; // Both
+    bool templatesValid { false };
+    std::vector<drm_color_lut> gammaTable;
+    UInt32 allocCheckWarmup {};
 
     // Async communication
     std::optional<std::promise<bool>> unitPromise;
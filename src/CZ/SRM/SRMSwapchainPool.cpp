@@ -0,0 +1,120 @@
+#include <CZ/SRM/SRMSwapchainPool.h>
+#include <CZ/SRM/SRMDevice.h>
+#include <CZ/SRM/SRMPlane.h>
+
+#include <algorithm>
+#include <drm_fourcc.h>
+
+using namespace CZ;
+
+bool SRMSwapchainPool::SameKey(const Key &a, const Key &b) noexcept
+{
+    return a.strategy == b.strategy &&
+           a.zeroCopy == b.zeroCopy &&
+           a.size == b.size &&
+           a.format == b.format &&
+           a.modifier == b.modifier;
+}
+
+void SRMSwapchainPool::put(const Key &key, Buffer &&buffer) noexcept
+{
+    if (!buffer.fb)
+        return;
+
+    const std::lock_guard<std::mutex> lock { m_mutex };
+
+    if (m_maxBytes == 0)
+        return;
+
+    // Copy strategies keep a second image per buffer
+    const UInt64 images { (buffer.primeImage || buffer.dumbBuffer) ? 2ULL : 1ULL };
+
+    Entry &entry { m_entries.emplace_back() };
+    entry.key = key;
+    entry.buffer = std::move(buffer);
+    entry.bytes = static_cast<UInt64>(key.size.width()) * static_cast<UInt64>(key.size.height()) * 4 * images;
+    entry.lastUse = ++m_useCounter;
+    m_bytes += entry.bytes;
+    prune();
+}
+
+bool SRMSwapchainPool::take(SkISize size, UInt32 count, const SRMPlane *plane, std::vector<Buffer> *buffers, Key *key) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+
+    for (const auto &candidate : m_entries)
+    {
+        if (candidate.key.size != size)
+            continue;
+
+        const bool supported { plane->formats().has(candidate.key.format, candidate.key.modifier) ||
+            (candidate.key.modifier == DRM_FORMAT_MOD_LINEAR && plane->formats().has(candidate.key.format, DRM_FORMAT_MOD_INVALID)) };
+
+        if (!supported)
+            continue;
+
+        const auto matches { std::count_if(m_entries.begin(), m_entries.end(), [&candidate](const Entry &entry) {
+            return SameKey(entry.key, candidate.key);
+        })};
+
+        if (static_cast<UInt32>(matches) < count)
+            continue;
+
+        *key = candidate.key;
+        buffers->clear();
+        buffers->reserve(count);
+
+        for (size_t i = 0; i < m_entries.size() && buffers->size() < count;)
+        {
+            if (SameKey(m_entries[i].key, *key))
+            {
+                buffers->emplace_back(std::move(m_entries[i].buffer));
+                m_bytes -= m_entries[i].bytes;
+                m_entries.erase(m_entries.begin() + i);
+            }
+            else
+                i++;
+        }
+
+        m_stats.hits++;
+        m_device->log(CZTrace, CZLN, "Reusing {} pooled {}x{} swapchain buffers", count, size.width(), size.height());
+        return true;
+    }
+
+    m_stats.misses++;
+    return false;
+}
+
+void SRMSwapchainPool::prune() noexcept
+{
+    while (m_bytes > m_maxBytes && !m_entries.empty())
+    {
+        auto lru { std::min_element(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) {
+            return a.lastUse < b.lastUse;
+        })};
+
+        m_bytes -= lru->bytes;
+        m_entries.erase(lru);
+        m_stats.evictions++;
+    }
+}
+
+void SRMSwapchainPool::clear() noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    m_entries.clear();
+    m_bytes = 0;
+}
+
+void SRMSwapchainPool::setMaxBytes(UInt64 bytes) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    m_maxBytes = bytes;
+    prune();
+}
+
+SRMSwapchainPool::Stats SRMSwapchainPool::stats() const noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    return m_stats;
+}
@@ -0,0 +1,105 @@
+#ifndef SRMSWAPCHAINPOOL_H
+#define SRMSWAPCHAINPOOL_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <CZ/Ream/Ream.h>
+#include <CZ/skia/core/SkSize.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Per-device pool of idle swapchain buffers.
+ *
+ * Renderers return the buffers of discarded swapchains (mode changes, buffer count changes, uninitialization)
+ * and take them back when a swapchain with the same size is created, skipping image allocation and framebuffer
+ * creation. Buffers are keyed by rendering strategy, size, scanout format and modifier, and a swapchain is only
+ * taken from the pool when all of its buffers share a key supported by the primary plane.
+ *
+ * Idle buffers are destroyed in least recently returned order when the memory cap is exceeded.
+ */
+class CZ::SRMSwapchainPool final : public SRMObject
+{
+public:
+    struct Key
+    {
+        UInt32 strategy;
+        bool zeroCopy;
+        SkISize size;
+        RFormat format;    // Of the scanout buffer
+        RModifier modifier;
+    };
+
+    // Everything a strategy allocates for a single buffer, unused members are nullptr
+    struct Buffer
+    {
+        std::shared_ptr<RDRMFramebuffer> fb;
+        std::shared_ptr<RImage> image;
+        std::shared_ptr<RSurface> surface;
+        std::shared_ptr<RImage> primeImage;
+        std::shared_ptr<RSurface> primeSurface;
+        std::shared_ptr<RDumbBuffer> dumbBuffer;
+    };
+
+    struct Stats
+    {
+        UInt64 hits;
+        UInt64 misses;
+        UInt64 evictions;
+    };
+
+    SRMSwapchainPool(SRMDevice *device) noexcept : m_device(device) {}
+
+    /**
+     * @brief Stores a buffer no longer used by any swapchain.
+     */
+    void put(const Key &key, Buffer &&buffer) noexcept;
+
+    /**
+     * @brief Takes count buffers of the given size sharing a key whose format and modifier the plane supports.
+     *
+     * @return false if there aren't enough matching buffers, leaving the pool untouched.
+     */
+    bool take(SkISize size, UInt32 count, const SRMPlane *plane, std::vector<Buffer> *buffers, Key *key) noexcept;
+
+    /**
+     * @brief Destroys all idle buffers.
+     */
+    void clear() noexcept;
+
+    /**
+     * @brief Sets the max estimated memory of the idle buffers, in bytes.
+     *
+     * Sizes are estimated at 4 bytes per pixel per image. 0 disables the pool. Defaults to 128 MiB.
+     */
+    void setMaxBytes(UInt64 bytes) noexcept;
+    UInt64 maxBytes() const noexcept { return m_maxBytes; }
+
+    /**
+     * @brief Swapchains taken from the pool (hits), allocated (misses) and buffers evicted since the device was created.
+     */
+    Stats stats() const noexcept;
+private:
+    struct Entry
+    {
+        Key key;
+        Buffer buffer;
+        UInt64 bytes;
+        UInt64 lastUse;
+    };
+
+    static bool SameKey(const Key &a, const Key &b) noexcept;
+
+    // Drops the least recently returned buffers until under the cap
+    void prune() noexcept;
+
+    SRMDevice *m_device;
+    std::vector<Entry> m_entries;
+    UInt64 m_bytes {};
+    UInt64 m_maxBytes { 128 * 1024 * 1024 };
+    UInt64 m_useCounter {};
+    Stats m_stats {};
+    mutable std::mutex m_mutex;
+};
+
+#endif // SRMSWAPCHAINPOOL_H
@@ -0,0 +1,49 @@
+#include <CZ/SRM/SRMTestCache.h>
+
+using namespace CZ;
+
+bool SRMTestCache::find(const Key &key, int *result) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+
+    for (const auto &entry : m_entries)
+    {
+        if (entry.valid && entry.hash == key.hash())
+        {
+            *result = entry.result;
+            m_stats.hits++;
+            return true;
+        }
+    }
+
+    m_stats.misses++;
+    return false;
+}
+
+void SRMTestCache::store(const Key &key, int result) noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    m_entries[m_next] = { key.hash(), result, true };
+    m_next = (m_next + 1) % m_entries.size();
+}
+
+void SRMTestCache::clear() noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+
+    for (auto &entry : m_entries)
+        entry.valid = false;
+}
+
+SRMTestCache::Stats SRMTestCache::stats() const noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    return m_stats;
+}
+
+Float32 SRMTestCache::hitRate() const noexcept
+{
+    const std::lock_guard<std::mutex> lock { m_mutex };
+    const UInt64 total { m_stats.hits + m_stats.misses };
+    return total == 0 ? 0.f : static_cast<Float32>(m_stats.hits) / static_cast<Float32>(total);
+}
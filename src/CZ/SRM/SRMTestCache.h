@@ -0,0 +1,78 @@
+#ifndef SRMTESTCACHE_H
+#define SRMTESTCACHE_H
+
+#include <CZ/SRM/SRMObject.h>
+#include <array>
+#include <mutex>
+
+/**
+ * @brief Cache of `DRM_MODE_ATOMIC_TEST_ONLY` outcomes of a CRTC.
+ *
+ * Plane configurations are described by a canonical hash (formats, modifiers, sizes, scaling,
+ * z-order, etc) instead of framebuffer ids, so the buffers clients cycle through share entries.
+ * Cleared on modesets, hotplug events and when a commit of a previously validated configuration fails.
+ *
+ * @see SRMCrtc::testCache()
+ */
+class CZ::SRMTestCache final : public SRMObject
+{
+public:
+    /**
+     * @brief Incremental FNV-1a hash of a plane configuration.
+     */
+    class Key
+    {
+    public:
+        Key &add(UInt64 value) noexcept
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                m_hash ^= (value >> (i * 8)) & 0xFF;
+                m_hash *= 1099511628211ULL;
+            }
+
+            return *this;
+        }
+
+        UInt64 hash() const noexcept { return m_hash; }
+    private:
+        UInt64 m_hash { 14695981039346656037ULL };
+    };
+
+    struct Stats
+    {
+        UInt64 hits;
+        UInt64 misses;
+    };
+
+    /**
+     * @brief Looks up the result of a previous test.
+     *
+     * @return true if found, the kernel result (0 or -errno) is stored in result.
+     */
+    bool find(const Key &key, int *result) noexcept;
+    void store(const Key &key, int result) noexcept;
+    void clear() noexcept;
+
+    Stats stats() const noexcept;
+
+    /**
+     * @brief Fraction of lookups answered by the cache in the range [0, 1].
+     */
+    Float32 hitRate() const noexcept;
+private:
+    struct Entry
+    {
+        UInt64 hash;
+        int result;
+        bool valid;
+    };
+
+    // Fixed size, the oldest entry is replaced
+    std::array<Entry, 64> m_entries {};
+    UInt32 m_next {};
+    Stats m_stats {};
+    mutable std::mutex m_mutex;
+};
+
+#endif // SRMTESTCACHE_H